@@ -0,0 +1,25 @@
+#!/bin/sh
+# Native builds of the engine tools (UCI front end, match runner, EPD runner, tuner, PGN annotator,
+# mate solver)
+# and of the UI replay driver on the GEOS stand-in, for testing on the host.  The engine benchmark
+# is built too and its rules test run.
+mkdir -p target
+
+CC=${CC:-cc}
+CFLAGS=${CFLAGS:-"-O2"}
+
+cd src
+
+$CC $CFLAGS -o ../target/geochess-uci geochess-uci.c -lpthread || exit 1
+$CC $CFLAGS -o ../target/geochess-match geochess-match.c -lm -lpthread || exit 1
+$CC $CFLAGS -o ../target/geochess-epd geochess-epd.c -lpthread || exit 1
+$CC $CFLAGS -O3 -ffast-math -o ../target/geochess-tune geochess-tune.c -lm -lpthread || exit 1
+$CC $CFLAGS -o ../target/geochess-pgn geochess-pgn.c -lpthread || exit 1
+$CC $CFLAGS -o ../target/geochess-mate geochess-mate.c -lpthread || exit 1
+$CC $CFLAGS -funsigned-char -Wno-unknown-pragmas -DPHASE_PROBES -Igeos-host -o ../target/geochess-replay geochess-replay.c geos-host/geos-host.c || exit 1
+
+# the GEOS build's engine, natively: its game-ending answers must be right
+$CC $CFLAGS -funsigned-char -Wno-unknown-pragmas -o ../target/geochess-bench geochess-bench.c || exit 1
+../target/geochess-bench rules > /dev/null || { ../target/geochess-bench rules; exit 1; }
+
+cd ..
@@ -4,7 +4,52 @@ mkdir target
 
 cd src
 
-cl65 -t geos-cbm -O -o ../target/geochess.cvt geochess-res.grc geochess.c
+# PROBES=1 ./build.sh adds the phase timing probes and the "timings" menu item
+if [ -n "$PROBES" ]; then
+    PROBE_FLAGS="-DPHASE_PROBES"
+fi
+
+cl65 -t geos-cbm -O $PROBE_FLAGS -m ../target/geochess.map -o ../target/geochess.cvt geochess-res.grc geochess.c
+
+# size of the resident core and of each overlay record, and the RAM left
+# between the resident core and the C stack below the overlay area
+awk '
+function hex(s,   i, n) {
+    s = tolower(s)
+    for (i = 1; i <= length(s); i++)
+        n = n * 16 + index("0123456789abcdef", substr(s, i, 1)) - 1
+    return n
+}
+/^Segment list:/    { segments = 1; next }
+/^Exports list/     { segments = 0 }
+segments && $1 ~ /^OVERLAY[0-9]+$/ {
+    n = substr($1, 8) + 0
+    overlay[n] = hex($4)
+    if (n > overlays) overlays = n
+    if (overlay[n] > largest) largest = overlay[n]
+    next
+}
+segments && NF == 5 && $2 ~ /^[0-9A-Fa-f]+$/ && $1 != "ZEROPAGE" && $1 != "EXTZP" && $1 != "HEADER" && $1 != "DIRENTRY" && $1 != "FILEINFO" {
+    resident += hex($4)
+    if (hex($3) + 1 > top) top = hex($3) + 1
+}
+{
+    for (i = 1; i < NF; i++) {
+        if ($i == "__OVERLAYADDR__") overlay_addr = hex($(i + 1))
+        if ($i == "__OVERLAYSIZE__") overlay_size = hex($(i + 1))
+        if ($i == "__STACKSIZE__") stack_size = hex($(i + 1))
+    }
+}
+END {
+    printf "resident core      %6d bytes\n", resident
+    for (n = 1; n <= overlays; n++)
+        printf "overlay %-10d %6d bytes\n", n, overlay[n]
+    # ld65 fails when a record overflows; an area too big only wastes RAM
+    if (overlay_size)
+        printf "overlay area       %6d bytes, overlaysize 0x%x would do\n", overlay_size, int((largest + 255) / 256) * 256
+    if (overlay_addr)
+        printf "free for the engine %5d bytes\n", overlay_addr - stack_size - top
+}' ../target/geochess.map
 
 rm -f *.o
 
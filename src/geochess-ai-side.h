@@ -0,0 +1,147 @@
+//===================================================================================
+//
+//                                  GEOCHESS
+//
+// geoChess is a chess game for GEOS under the Commodore 64 and 128 computers
+//
+// Written by Scott Hutter
+// Nov 2023
+//
+// You are free to modify this code as desired, as long as original author credit
+// is mentioned for both the geos code and the included AI engines
+//===================================================================================
+
+//*********************************************************************************
+//
+// Move generator and evaluator for one side to move.  geochess-ai.h includes
+// this file twice, once per colour, so the side mask, pawn steps and double
+// push rank are constants and the inner loops carry no pawn tests.  Moves
+// come out in the same order as the generic generator.
+//
+//  GEN_SIDE        8 or 16
+//  GEN_PUSH        pawn step forward
+//  GEN_CAPTURE_1   pawn capture steps, in move_offsets[] order
+//  GEN_CAPTURE_2
+//  GEN_PUSH_RANK   (dst & 0x70) after a single push that may push again
+//  GEN_MOVES       name of the generator
+//  GEN_EVALUATE    name of the evaluator
+//
+//********************************************************************************
+
+// pseudo-legal moves of GEN_SIDE, or KING_CAPTURE
+unsigned char GEN_MOVES(ENGINE_PARAM_ struct move *list)
+{
+    int piece, type, directions, dst_square, captured_piece, step_vector;
+    int src_square;
+    unsigned char count = 0;
+
+    for(src_square = 0; src_square < 128; src_square++)
+    {
+        if(!(src_square & 0x88))
+        {
+            piece = ENG.board[src_square];
+
+            if(!(piece & GEN_SIDE))
+                continue;
+
+            type = piece & 7;
+
+            if(type < 3)
+            {
+                // capture, push (twice from the start rank), capture
+                dst_square = src_square + GEN_CAPTURE_1;
+                if(!(dst_square & 0x88) && ((captured_piece = ENG.board[dst_square]) & (24 - GEN_SIDE)))
+                {
+                    if((captured_piece & 7) == 3) return KING_CAPTURE;
+                    list[count].src = src_square;
+                    list[count].dst = dst_square;
+                    ++count;
+                }
+
+                dst_square = src_square + GEN_PUSH;
+                if(!(dst_square & 0x88) && !ENG.board[dst_square])
+                {
+                    list[count].src = src_square;
+                    list[count].dst = dst_square;
+                    ++count;
+
+                    if((dst_square & 0x70) == GEN_PUSH_RANK && !ENG.board[dst_square + GEN_PUSH])
+                    {
+                        list[count].src = src_square;
+                        list[count].dst = dst_square + GEN_PUSH;
+                        ++count;
+                    }
+                }
+
+                dst_square = src_square + GEN_CAPTURE_2;
+                if(!(dst_square & 0x88) && ((captured_piece = ENG.board[dst_square]) & (24 - GEN_SIDE)))
+                {
+                    if((captured_piece & 7) == 3) return KING_CAPTURE;
+                    list[count].src = src_square;
+                    list[count].dst = dst_square;
+                    ++count;
+                }
+
+                continue;
+            }
+
+            directions = move_offsets[type + 30];
+
+            while((step_vector = move_offsets[++directions]))
+            {
+                dst_square = src_square;
+
+                do
+                {
+                    dst_square += step_vector;
+
+                    if(dst_square & 0x88) break;
+
+                    captured_piece = ENG.board[dst_square];
+
+                    if(captured_piece & GEN_SIDE) break;
+                    if((captured_piece & 7) == 3) return KING_CAPTURE;
+
+                    list[count].src = src_square;
+                    list[count].dst = dst_square;
+                    ++count;
+                }
+
+                while(!captured_piece && type >= 5);    // only sliders go on
+            }
+        }
+    }
+
+    return count;
+}
+
+// material + positional score from GEN_SIDE's point of view
+int GEN_EVALUATE(ENGINE_PARAM)
+{
+    int mat_score = 0;
+    int pos_score = 0;
+    int pce;
+    unsigned char sq;
+
+    for(sq = 0; sq < 128; sq++)
+    {
+        if(!(sq & 0x88))
+        {
+            if((pce = ENG.board[sq]))
+            {
+                mat_score += ENG.piece_weights[pce & 15]; // material score, white's view
+                (pce & GEN_SIDE) ? (pos_score += ENG.board[sq + 8]) : (pos_score -= ENG.board[sq + 8]); // positional score
+            }
+        }
+    }
+
+    return (GEN_SIDE == 8) ? pos_score + mat_score : pos_score - mat_score;
+}
+
+#undef GEN_SIDE
+#undef GEN_PUSH
+#undef GEN_CAPTURE_1
+#undef GEN_CAPTURE_2
+#undef GEN_PUSH_RANK
+#undef GEN_MOVES
+#undef GEN_EVALUATE
@@ -16,12 +16,13 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include "geochess-engine.h"
 
 //*********************************************************************************
 //
 // FUTURE DEVELOPERS: This code can be replaced.  
-// GeoChess just needs to be able to translate in chess notation
-// between player and AI moves.
+// GeoChess only talks to it through the engine interface in
+// geochess-engine.h, see bmcp_engine at the end.
 //
 //********************************************************************************
 
@@ -123,250 +124,1702 @@ static int move_offsets[] = {
 
 };
 
-int piece_weights[] = { 0, 0, -100, 0, -300, -350, -500, -900, 0, 100, 0, 0, 300, 350, 500, 900 };
-int best_src, best_dst;    // to store the best move found in search
+int default_piece_weights[] = { 0, 0, -100, 0, -300, -350, -500, -900, 0, 100, 0, 0, 300, 350, 500, 900 };
 
-char user_move[5];
-char ai_move[5];
-int depth = 2;
-int side = CWHITE;
-int user_src, user_dst;
+// deepest line the principal variation can hold
+#ifndef MAX_PLY
+#define MAX_PLY         8
+#endif
 
-int sq = 0;
-int score =0;
+// root moves a multi-PV search keeps at most, see ENG.multipv
+#ifndef MULTIPV_MAX
+#define MULTIPV_MAX     2
+#endif
 
-unsigned char ch = 0;
-unsigned char x = 0;
+// search_progress is called every (PROGRESS_MASK + 1) nodes
+#ifndef PROGRESS_MASK
+#define PROGRESS_MASK   63
+#endif
 
-void engine_init(void)
+// moves of every ply being searched share one stack
+#ifndef MOVE_STACK
+#define MOVE_STACK      256
+#endif
+
+// GenerateMoves() result when the side to move can take the enemy king
+#define KING_CAPTURE    255
+
+// Scores.  A side that can take the enemy king scores KING_TAKEN, which
+// tells the parent its move was illegal; windows start at -KING_TAKEN and
+// KING_TAKEN.  Mated n plies from the root scores n - MATE, so a nearer
+// mate is further from 0, and a score past MATE_BOUND either way is a mate.
+#define KING_TAKEN      10000
+#define MATE            9000
+#define MATE_BOUND      (MATE - MAX_PLY)
+
+#define NO_MOVE         0xff        // src of ENG.best when there is no legal move
+
+// castling rights, ENG.castle
+#define CASTLE_WK       1
+#define CASTLE_WQ       2
+#define CASTLE_BK       4
+#define CASTLE_BQ       8
+
+#define NO_EP           0x88        // ENG.ep when no pawn can be taken en passant
+
+// All engine state lives in one context.  Host builds define ENGINE_REENTRANT
+// and pass a context pointer to every engine function, so any number of
+// engines can search at once.  The GEOS build keeps a single static context
+// and the parameter disappears, so ENG.board[sq] costs the same as a global.
+#ifdef ENGINE_REENTRANT
+struct engine;
+#define ENGINE_PARAM    struct engine *e
+#define ENGINE_PARAM_   struct engine *e,
+#define ENGINE_ARG      e
+#define ENGINE_ARG_     e,
+#define ENG             (*e)
+#else
+#define ENGINE_PARAM    void
+#define ENGINE_PARAM_
+#define ENGINE_ARG
+#define ENGINE_ARG_
+#define ENG             engine
+#endif
+
+// the 16-bit move word of geochess-engine.h
+struct move {
+    unsigned char src, dst;
+};
+
+// Host builds define ENGINE_HASH for a transposition table and move
+// ordering.  The table may be shared by several engines searching at once
+// (see search_best() in geochess-host.h): each entry stores its key XORed
+// with its data, so an entry torn by two writers fails the key test and
+// reads as a miss instead of returning another position's data.  Killer
+// moves and history counts belong to each engine.
+#ifdef ENGINE_HASH
+
+#ifndef ENGINE_REENTRANT
+#error ENGINE_HASH needs the reentrant engine
+#endif
+
+typedef unsigned long long hash_key;
+
+struct tt_entry {
+    hash_key check;                 // key ^ data
+    hash_key data;                  // score, depth, bound and move
+};
+
+#define TT_UPPER        1
+#define TT_LOWER        2
+#define TT_EXACT        3
+
+#define TT_MISS         -32768      // tt_probe() found nothing usable
+
+hash_key zobrist[24][128];          // by piece and square, piece 0 stays 0
+hash_key zobrist_side;              // black to move
+hash_key zobrist_castle[16];        // by rights left, no rights stays 0
+hash_key zobrist_ep[8];             // by file of the en passant square
+
+#endif
+
+// Pawn structure scores are kept by a key of the pawns alone, which changes
+// only on pawn moves and pawn captures, see evaluate_terms().
+#ifndef PAWN_ENTRIES
+#define PAWN_ENTRIES    64          // a power of two
+#endif
+
+struct pawn_entry {
+    unsigned int key;
+    int score;                      // white's view
+    unsigned char files[2];         // files holding white and black pawns, bit 0 = a
+};
+
+unsigned int pawn_keys[2][64];      // by colour and square
+unsigned char pawn_ready = 0;
+
+#define PAWN_INDEX(sq)  ((((sq) >> 1) & 0x38) | ((sq) & 7))    // 0x88 square to 0..63
+
+// The positions since the last capture, pawn move or lost castling right,
+// the game's and the search path's together, are kept by key in a ring of
+// REP_RING (a power of two) to find repetitions.  A search overwrites up to
+// MAX_PLY of the oldest, so REP_RING - MAX_PLY are looked back on.
+#ifndef REP_RING
+#define REP_RING        32
+#endif
+
+// Host builds compare Zobrist keys.  The GEOS build keys only the pieces
+// other than pawns, in 16 bits: between two irreversible moves the pawns
+// and the castling rights stay as they are, and each side is compared with
+// its own moves only.  A piece on a square draws on the pawn keys of both
+// colours.
+#ifdef ENGINE_HASH
+typedef hash_key rep_key;
+#define REP_KEY         ENG.hash
+#else
+typedef unsigned int rep_key;
+#define REP_KEY         ENG.piece_key
+#define PIECE_KEY(piece, sq)    (pawn_keys[(piece) >> 4][PAWN_INDEX(sq)] \
+                                ^ pawn_keys[((piece) >> 4) ^ 1][(PAWN_INDEX(sq) + 9 * ((piece) & 7)) & 63])
+#endif
+
+// Host builds may define ENGINE_BITBOARDS to generate moves from 64-bit sets
+// of squares kept next to the board, see geochess-ai-bitboard.h.
+#ifdef ENGINE_BITBOARDS
+typedef unsigned long long bitboard;
+
+void bb_init(void);
+#endif
+
+// What make_move() cannot work out again when the move is taken back.
+// Searches push one entry per ply, so the stack is as deep as the PV.
+struct undo {
+    int piece, captured;            // moved and taken, as the board had them
+    unsigned char castle, ep;
+    unsigned int pawn_key;
+    unsigned int fifty;
+#ifdef ENGINE_HASH
+    hash_key hash;
+#else
+    unsigned int piece_key;
+#endif
+};
+
+// one of the best root moves of a multi-PV search
+struct root_move {
+    struct move move;
+    int score;                      // exact
+    struct move pv[MAX_PLY];        // its line, the move first
+    unsigned char pv_length;
+};
+
+struct engine {
+    int board[128];                 // 0x88 board + positional scores
+    int piece_weights[16];
+    struct move best;               // to store the best move found in search
+    int side;
+    unsigned char castle;           // CASTLE_* rights left
+    unsigned char ep;               // square a pawn can take en passant, or NO_EP
+    int depth;
+    int score;
+
+    struct search_stats stats;
+    void (*search_progress)(ENGINE_PARAM);  // optional hook for live display or time checks
+    unsigned char search_stop;              // set (usually by search_progress) to abandon the search
+
+    // triangular principal variation table, indexed by ply
+    struct move pv[MAX_PLY][MAX_PLY];
+    unsigned char pv_length[MAX_PLY];
+    unsigned char ply;
+
+    // Multi-PV: with multipv above 1 (and up to MULTIPV_MAX) the root
+    // searches with its window open to the weakest of the best multipv
+    // moves so far, and keeps them in root_moves, best first.
+    unsigned char multipv;
+    unsigned char root_count;
+    struct root_move root_moves[MULTIPV_MAX];
+
+    struct move move_stack[MOVE_STACK];
+    unsigned int move_sp;           // first free entry of move_stack
+
+    struct undo undo_stack[MAX_PLY];
+    unsigned char undo_sp;          // first free entry of undo_stack
+
+#ifdef ENGINE_HASH
+    hash_key hash;                  // of the position being searched
+    struct tt_entry *tt;            // 0 = no table, search as plain BMCP
+    unsigned long tt_mask;          // entries - 1, a power of two less one
+    struct move killers[MAX_PLY][2];
+    unsigned int history[128][128]; // cutoffs by source and destination
+#endif
+
+    unsigned int pawn_key;          // of the pawns of the position being searched
+    struct pawn_entry pawn_table[PAWN_ENTRIES];
+
+    rep_key rep_ring[REP_RING];     // keys of the positions moved from, oldest overwritten
+    unsigned int rep_sp;            // moves made since the game was set up
+    unsigned int fifty;             // half-moves since the last capture or pawn move
+#ifndef ENGINE_HASH
+    rep_key piece_key;              // see PIECE_KEY()
+#endif
+
+#ifdef ENGINE_BITBOARDS
+    bitboard pieces[24];            // squares of each piece code
+    bitboard occupied[2];           // squares of white and black
+#endif
+};
+
+#ifndef ENGINE_REENTRANT
+struct engine engine;
+#endif
+
+void engine_stats_reset(ENGINE_PARAM_ unsigned char search_depth)
+{
+    memset(&ENG.stats, 0, sizeof(ENG.stats));
+    ENG.stats.depth = search_depth;
+    ENG.stats.start = ENGINE_TICKS();
+    ENG.pv_length[0] = 0;
+    ENG.ply = 0;
+    ENG.move_sp = 0;
+    ENG.undo_sp = 0;
+}
+
+void engine_stats_finish(ENGINE_PARAM)
+{
+    ENG.stats.elapsed = ENGINE_TICKS() - ENG.stats.start;
+}
+
+// The GEOS build loads the search, its move ordering and evaluation terms and
+// BMCP's interface as a VLIR overlay.  Move generation, making and taking
+// back moves and the king attack test stay in the resident core for the mate
+// solver, which has an overlay of its own (geochess-mate.h); so do
+// bmcp_get_pv() and the statistics helpers, called while other overlays are
+// loaded.
+#ifndef ENGINE_OVERLAY
+#define ENGINE_OVERLAY  0
+#endif
+
+#if ENGINE_OVERLAY
+#pragma code-name(push, "OVERLAY1")
+#pragma rodata-name(push, "OVERLAY1")
+#endif
+
+// fixed keys, from a 16-bit xorshift
+void pawn_init(void)
+{
+    unsigned int x = 0xace1;
+    unsigned char colour, i;
+
+    if(pawn_ready)
+        return;
+
+    for(colour = 0; colour < 2; colour++)
+    {
+        for(i = 0; i < 64; i++)
+        {
+            x ^= x << 7;
+            x ^= x >> 9;
+            x ^= x << 8;
+            pawn_keys[colour][i] = x;
+        }
+    }
+
+    pawn_ready = 1;
+}
+
+unsigned int pawn_key(ENGINE_PARAM)
+{
+    unsigned int key = 0;
+    unsigned char sq;
+    int piece;
+
+    for(sq = 0; sq < 128; sq++)
+        if(!(sq & 0x88) && (piece = ENG.board[sq]) && (piece & 7) < 3)
+            key ^= pawn_keys[piece >> 4][PAWN_INDEX(sq)];
+
+    return key;
+}
+
+// a new game or a position set from outside: no earlier positions to repeat
+// and no half-moves toward the fifty
+void history_reset(ENGINE_PARAM)
+{
+    ENG.rep_sp = 0;
+    ENG.fifty = 0;
+}
+
+void engine_init(ENGINE_PARAM)
 {
     unsigned char i;
 
     for (i = 0; i < 128; i++)
-        board[i] = starting_board[i];
+        ENG.board[i] = starting_board[i];
+
+    memcpy(ENG.piece_weights, default_piece_weights, sizeof(ENG.piece_weights));
 
-    side = CWHITE;
-    depth = 2;
+    ENG.side = CWHITE;
+    ENG.castle = CASTLE_WK | CASTLE_WQ | CASTLE_BK | CASTLE_BQ;
+    ENG.ep = NO_EP;
+    ENG.depth = 2;
+    ENG.search_stop = 0;
+    history_reset(ENGINE_ARG);
 
+    pawn_init();
+    memset(ENG.pawn_table, 0, sizeof(ENG.pawn_table));
+
+#ifdef ENGINE_BITBOARDS
+    bb_init();
+#endif
 }
 
-int SearchPosition(int side, int depth, int alpha, int beta)
+#if ENGINE_OVERLAY
+#pragma rodata-name(pop)
+#pragma code-name(pop)
+#endif
+
+// The move generator and the leaf evaluator are the inner loops of the
+// search.  Perft() must count the same nodes with the 0x88 versions below
+// and the bitboard versions host builds get with ENGINE_BITBOARDS.
+#ifdef ENGINE_BITBOARDS
+
+#include "geochess-ai-bitboard.h"
+
+// make and take back keep the sets in step with the board
+#define BB_TOGGLE(src, dst, piece, captured)    bb_toggle(ENGINE_ARG_ src, dst, piece, captured, ENG.board[dst])
+#define BB_LIFT(sq, piece)                      bb_lift(ENGINE_ARG_ sq, piece)
+
+#else
+
+// GenerateWhite(), EvaluateWhite(), GenerateBlack() and EvaluateBlack()
+#define GEN_SIDE        8
+#define GEN_PUSH        -16
+#define GEN_CAPTURE_1   -15
+#define GEN_CAPTURE_2   -17
+#define GEN_PUSH_RANK   0x50
+#define GEN_MOVES       GenerateWhite
+#define GEN_EVALUATE    EvaluateWhite
+#include "geochess-ai-side.h"
+
+#define GEN_SIDE        16
+#define GEN_PUSH        16
+#define GEN_CAPTURE_1   15
+#define GEN_CAPTURE_2   17
+#define GEN_PUSH_RANK   0x20
+#define GEN_MOVES       GenerateBlack
+#define GEN_EVALUATE    EvaluateBlack
+#include "geochess-ai-side.h"
+
+#endif
+
+// Store the pseudo-legal moves of side in list, in board order.  Returns the
+// number of moves, or KING_CAPTURE if the enemy king can be taken, which
+// means the move that led here was illegal.
+unsigned char GenerateMoves(ENGINE_PARAM_ unsigned char side, struct move *list)
+{
+    return (side == 8) ? GenerateWhite(ENGINE_ARG_ list) : GenerateBlack(ENGINE_ARG_ list);
+}
+
+// material + positional score from white's point of view
+int Evaluate(ENGINE_PARAM)
 {
-    int mat_score = 0;
-    int pos_score = 0;
-    int pce = 0;
-    int eval = 0;
+    return EvaluateWhite(ENGINE_ARG);
+}
 
-    int old_alpha = alpha;
-    int temp_src;
-    int temp_dst;
-    int score = -10000;
+#ifndef BB_TOGGLE
+#define BB_TOGGLE(src, dst, piece, captured)
+#define BB_LIFT(sq, piece)
+#endif
 
-    int piece, type, directions, dst_square, captured_square, captured_piece, step_vector;
-    int sq = 0;
-    int src_square = 0;
+// least valuable piece of side attacking sq, or -1
+int see_attacker(ENGINE_PARAM_ int sq, int side)
+{
+    static const int knight_steps[8] = { 14, -14, 18, -18, 31, -31, 33, -33 };
+    static const int king_steps[8] = { 1, -1, 16, -16, 15, -15, 17, -17 };
+    int best = -1, best_type = 8;
+    int t, piece, i;
 
-    if(!depth)
+    // a white pawn takes towards the 8th rank, so it stands below the square
+    for(i = 15; i <= 17; i += 2)
+    {
+        t = (side == 8) ? sq + i : sq - i;
+        if(!(t & 0x88) && ((piece = ENG.board[t]) & side) && (piece & 7) < 3)
+            return t;
+    }
+
+    for(i = 0; i < 8; i++)
+    {
+        t = sq + knight_steps[i];
+        if(!(t & 0x88) && ENG.board[t] == (side | 4))
+            return t;
+    }
+
+    // the first piece along each line, bishops before rooks before queens
+    for(i = 0; i < 8; i++)
+    {
+        t = sq;
+        do
+            t += king_steps[i];
+        while(!(t & 0x88) && !ENG.board[t]);
+
+        if(!(t & 0x88) && ((piece = ENG.board[t]) & side))
+        {
+            piece &= 7;
+            if(piece == 7 || piece == ((i < 4) ? 6 : 5))
+            {
+                if(piece < best_type)
+                {
+                    best = t;
+                    best_type = piece;
+                }
+            }
+        }
+    }
+
+    if(best >= 0)
+        return best;
+
+    for(i = 0; i < 8; i++)
+    {
+        t = sq + king_steps[i];
+        if(!(t & 0x88) && ENG.board[t] == (side | 3))
+            return t;
+    }
+
+    return -1;
+}
+
+// true if the king of side can be taken: in check, or left en prise
+unsigned char king_attacked(ENGINE_PARAM_ int side)
+{
+    int sq;
+
+    for(sq = 0; sq < 128; sq++)
+    {
+        if(!(sq & 0x88) && ENG.board[sq] == (side | 3))
+            return see_attacker(ENGINE_ARG_ sq, 24 - side) >= 0;
+    }
+
+    return 0;
+}
+
+#if ENGINE_OVERLAY
+#pragma code-name(push, "OVERLAY1")
+#pragma rodata-name(push, "OVERLAY1")
+#endif
+
+// Static exchange evaluation: the material a capture wins once both sides
+// have traded every piece they can bring to the square, least valuable
+// first, each side free to stop when going on would lose.  Pieces are lifted
+// off the board as they capture, so sliders behind them join in, and put
+// back before returning.  Promotions in the sequence are not counted.
+static const int see_values[8] = { 0, 100, 100, 2000, 300, 350, 500, 900 };   // by piece & 7
+
+// material won by the capture src-dst, from the capturing side's view
+int see(ENGINE_PARAM_ int src, int dst)
+{
+    int gain[32];
+    unsigned char lifted[32];
+    unsigned char lifted_piece[32];
+    int side = ENG.board[src] & 24;
+    int attacker = src;
+    unsigned char d = 0, n = 0;
+
+    gain[0] = see_values[ENG.board[dst] & 7];
+
+    do
+    {
+        // what is left if the piece now capturing is taken in turn
+        ++d;
+        gain[d] = see_values[ENG.board[attacker] & 7] - gain[d - 1];
+        if(-gain[d - 1] < 0 && gain[d] < 0)
+            break;
+
+        lifted[n] = attacker;
+        lifted_piece[n++] = ENG.board[attacker];
+        ENG.board[attacker] = 0;
+
+        side = 24 - side;
+    }
+    while(d < 31 && (attacker = see_attacker(ENGINE_ARG_ dst, side)) >= 0);
+
+    while(n--)
+        ENG.board[lifted[n]] = lifted_piece[n];
+
+    // each side keeps the better of stopping and going on
+    while(--d)
+        if(-gain[d - 1] < gain[d])
+            gain[d - 1] = -gain[d];
+
+    return gain[0];
+}
+
+// true if the capture src-dst does not lose material; most captures take a
+// piece worth at least the capturer and need no exchange worked out
+unsigned char see_safe(ENGINE_PARAM_ int src, int dst)
+{
+    return see_values[ENG.board[dst] & 7] >= see_values[ENG.board[src] & 7]
+        || see(ENGINE_ARG_ src, dst) >= 0;
+}
+
+// Move the captures that do not lose material to the front and the ones that
+// do to the back, the rest keep their order.  Returns the number of moves
+// ahead of the losing captures.  Searches without the hash table order
+// their moves with this; order_moves() does the same and more.
+unsigned char order_captures(ENGINE_PARAM_ struct move *list, unsigned char count)
+{
+    struct move move;
+    unsigned char m = 0, i, front = 0, back = count;
+
+    while(m < back)
+    {
+        move = list[m];
+
+        if(!ENG.board[MOVE_SQUARE(move.dst)])
+            ++m;
+        else if(see_safe(ENGINE_ARG_ MOVE_SQUARE(move.src), MOVE_SQUARE(move.dst)))
+        {
+            for(i = m++; i > front; i--)
+                list[i] = list[i - 1];
+            list[front++] = move;
+        }
+        else
+        {
+            for(i = m, --back; i < back; i++)
+                list[i] = list[i + 1];
+            list[back] = move;
+        }
+    }
+
+    return back;
+}
+
+// Evaluation terms added to the material and square tables at the leaves,
+// all from white's point of view.  The pawn structure only changes when a
+// pawn moves or is taken, so its score is looked up by ENG.pawn_key and
+// worked out again only on a miss.
+#define DOUBLED_PAWN    12          // each pawn beyond the first on a file
+#define ISOLATED_PAWN   10          // no pawns of its side on either next file
+#define SHELTER_PAWN    10          // own pawn next to and in front of the king
+#define OPEN_KING_FILE  15          // king's file or a next one without own pawns
+
+static const int passed_bonus[6] = { 5, 10, 20, 35, 60, 100 };      // by steps from the start row
+static const int mobility_weight[8] = { 0, 0, 0, 0, 3, 3, 2, 1 };     // per square, by piece & 7
+
+struct pawn_entry *evaluate_pawns(ENGINE_PARAM)
+{
+    struct pawn_entry *entry = &ENG.pawn_table[ENG.pawn_key & (PAWN_ENTRIES - 1)];
+    unsigned char count[2][10];     // pawns per file, file + 1 so both neighbours exist
+    unsigned char white_back[10];   // row of the rearmost white pawn, 0 = none
+    unsigned char black_back[10];   // row of the rearmost black pawn, 7 = none
+    unsigned char sq, file, row, colour;
+    int piece, score = 0;
+
+    if(entry->key == ENG.pawn_key)
+        return entry;
+
+    memset(count, 0, sizeof(count));
+    memset(white_back, 0, sizeof(white_back));
+    memset(black_back, 7, sizeof(black_back));
+    entry->files[0] = entry->files[1] = 0;
+
+    for(sq = 0; sq < 128; sq++)
+    {
+        if(!(sq & 0x88) && (piece = ENG.board[sq]) && (piece & 7) < 3)
+        {
+            file = (sq & 7) + 1;
+            row = sq >> 4;
+            colour = piece >> 4;
+
+            ++count[colour][file];
+            entry->files[colour] |= 1 << (file - 1);
+
+            if(colour)
+            {
+                if(row < black_back[file])
+                    black_back[file] = row;
+            }
+            else if(row > white_back[file])
+                white_back[file] = row;
+        }
+    }
+
+    for(sq = 0; sq < 128; sq++)
+    {
+        if(!(sq & 0x88) && (piece = ENG.board[sq]) && (piece & 7) < 3)
+        {
+            file = (sq & 7) + 1;
+            row = sq >> 4;
+
+            if(piece & 8)
+            {
+                if(!count[0][file - 1] && !count[0][file + 1])
+                    score -= ISOLATED_PAWN;
+
+                // no black pawn ahead on this file or the next ones
+                if(black_back[file - 1] >= row && black_back[file] >= row && black_back[file + 1] >= row)
+                    score += passed_bonus[6 - row];
+            }
+            else
+            {
+                if(!count[1][file - 1] && !count[1][file + 1])
+                    score += ISOLATED_PAWN;
+
+                if(white_back[file - 1] <= row && white_back[file] <= row && white_back[file + 1] <= row)
+                    score -= passed_bonus[row - 1];
+            }
+        }
+    }
+
+    for(file = 1; file < 9; file++)
+    {
+        if(count[0][file] > 1)
+            score -= (count[0][file] - 1) * DOUBLED_PAWN;
+        if(count[1][file] > 1)
+            score += (count[1][file] - 1) * DOUBLED_PAWN;
+    }
+
+    entry->key = ENG.pawn_key;
+    entry->score = score;
+    return entry;
+}
+
+// Shelter of the king of colour (0 white, 1 black) on sq: own pawns on the
+// three squares in front of it and the ones beyond, open files around it.
+// Only while the king is on its first two rows.
+int king_shelter(ENGINE_PARAM_ unsigned char sq, unsigned char colour, unsigned char files)
+{
+    int ahead = colour ? 16 : -16;
+    int pawn = colour ? 18 : 9;
+    int score = 0;
+    int t, file, f;
+
+    if((sq >> 4) != (colour ? 0 : 7) && (sq >> 4) != (colour ? 1 : 6))
+        return 0;
+
+    file = sq & 7;
+
+    for(f = file - 1; f <= file + 1; f++)
+    {
+        if(f < 0 || f > 7)
+            continue;
+
+        t = sq + ahead + f - file;
+        if(ENG.board[t] == pawn)
+            score += SHELTER_PAWN;
+        else if(!((t + ahead) & 0x88) && ENG.board[t + ahead] == pawn)
+            score += SHELTER_PAWN / 2;
+
+        if(!(files & (1 << f)))
+            score -= OPEN_KING_FILE;
+    }
+
+    return score;
+}
+
+int evaluate_terms(ENGINE_PARAM)
+{
+    struct pawn_entry *pawns = evaluate_pawns(ENGINE_ARG);
+    int score = pawns->score;
+    int piece, type, directions, step_vector, t;
+    unsigned char sq, king[2], queens[2] = { 0, 0 };
+    int mobility;
+
+    king[0] = king[1] = 0x88;
+
+    for(sq = 0; sq < 128; sq++)
+    {
+        if((sq & 0x88) || !(piece = ENG.board[sq]))
+            continue;
+
+        type = piece & 7;
+
+        if(type == 3)
+        {
+            king[piece >> 4] = sq;
+            continue;
+        }
+
+        if(type < 4)
+            continue;
+
+        if(type == 7)
+            queens[piece >> 4] = 1;
+
+        // squares the piece reaches that hold no piece of its own side
+        mobility = 0;
+        directions = move_offsets[type + 30];
+
+        while((step_vector = move_offsets[++directions]))
+        {
+            t = sq;
+
+            do
+            {
+                t += step_vector;
+
+                if((t & 0x88) || (ENG.board[t] & piece & 24))
+                    break;
+
+                ++mobility;
+            }
+            while(!ENG.board[t] && type >= 5);
+        }
+
+        mobility *= mobility_weight[type];
+        (piece & 8) ? (score += mobility) : (score -= mobility);
+    }
+
+    // the king needs cover while the other side has a queen
+    if(king[0] != 0x88 && queens[1])
+        score += king_shelter(ENGINE_ARG_ king[0], 0, pawns->files[0]);
+    if(king[1] != 0x88 && queens[0])
+        score -= king_shelter(ENGINE_ARG_ king[1], 1, pawns->files[1]);
+
+    return score;
+}
+
+#ifdef ENGINE_HASH
+
+// fixed keys, so every run and every thread hashes alike
+void hash_init(void)
+{
+    hash_key x = 0x9e3779b97f4a7c15ULL;
+    int piece, sq;
+
+    for(piece = 1; piece < 24; piece++)
     {
-        // Evaluate position        
-        //int mat_score = 0, pos_score = 0, pce, eval = 0;
-    
         for(sq = 0; sq < 128; sq++)
         {
-            if(!(sq & 0x88))
+            // xorshift64
+            x ^= x << 13;
+            x ^= x >> 7;
+            x ^= x << 17;
+            zobrist[piece][sq] = x;
+        }
+    }
+
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    zobrist_side = x;
+
+    for(sq = 1; sq < 16 + 8; sq++)
+    {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        if(sq < 16)
+            zobrist_castle[sq] = x;
+        else
+            zobrist_ep[sq - 16] = x;
+    }
+}
+
+hash_key hash_position(ENGINE_PARAM_ int side)
+{
+    hash_key key = (side == 16) ? zobrist_side : 0;
+    unsigned char sq;
+
+    for(sq = 0; sq < 128; sq++)
+        if(!(sq & 0x88) && ENG.board[sq])
+            key ^= zobrist[ENG.board[sq]][sq];
+
+    key ^= zobrist_castle[ENG.castle];
+    if(ENG.ep != NO_EP)
+        key ^= zobrist_ep[ENG.ep & 7];
+
+    return key;
+}
+
+// Score for this node if the table already settles it, else TT_MISS.  The
+// stored move, if any, goes to *hash_move for ordering.
+int tt_probe(ENGINE_PARAM_ int depth, int alpha, int beta, struct move *hash_move)
+{
+    struct tt_entry *entry = &ENG.tt[ENG.hash & ENG.tt_mask];
+    hash_key data = __atomic_load_n(&entry->data, __ATOMIC_RELAXED);
+    hash_key check = __atomic_load_n(&entry->check, __ATOMIC_RELAXED);
+    int score, bound;
+
+    if((check ^ data) != ENG.hash)
+        return TT_MISS;
+
+    hash_move->src = (unsigned char)(data >> 32);
+    hash_move->dst = (unsigned char)(data >> 40);
+
+    // the root always searches, so it has a best move and a PV
+    if(!ENG.ply || (int)((data >> 16) & 0xff) < depth)
+        return TT_MISS;
+
+    score = (short)(data & 0xffff);
+    bound = (int)(data >> 24) & 3;
+
+    // mates are stored by their distance from the node, not the root
+    if(score > MATE_BOUND)
+        score -= ENG.ply;
+    else if(score < -MATE_BOUND)
+        score += ENG.ply;
+
+    // scores stay inside the window, as the search fails hard
+    if(bound == TT_EXACT)
+        return (score <= alpha) ? alpha : (score >= beta) ? beta : score;
+    if(bound == TT_LOWER && score >= beta)
+        return beta;
+    if(bound == TT_UPPER && score <= alpha)
+        return alpha;
+
+    return TT_MISS;
+}
+
+void tt_store(ENGINE_PARAM_ int depth, int score, int bound, struct move move)
+{
+    struct tt_entry *entry = &ENG.tt[ENG.hash & ENG.tt_mask];
+    hash_key data;
+
+    if(score > MATE_BOUND)
+        score += ENG.ply;
+    else if(score < -MATE_BOUND)
+        score -= ENG.ply;
+
+    data = (hash_key)(unsigned short)score | (hash_key)(depth & 0xff) << 16
+        | (hash_key)bound << 24 | (hash_key)move.src << 32 | (hash_key)move.dst << 40;
+
+    __atomic_store_n(&entry->check, ENG.hash ^ data, __ATOMIC_RELAXED);
+    __atomic_store_n(&entry->data, data, __ATOMIC_RELAXED);
+}
+
+// Sort list best first: the table's move, captures that do not lose
+// material by what they win, the killers of this ply, the rest by history,
+// and last the losing captures.  Returns the number of moves ahead of the
+// losing captures.
+unsigned char order_moves(ENGINE_PARAM_ struct move *list, unsigned char count, struct move *hash_move)
+{
+    unsigned int keys[256];
+    unsigned int key;
+    struct move move, *killers = ENG.killers[ENG.ply];
+    int captured, gain;
+    unsigned char m, i, losing = 0;
+
+    for(m = 0; m < count; m++)
+    {
+        move = list[m];
+        captured = ENG.board[MOVE_SQUARE(move.dst)];
+
+        if(move.src == hash_move->src && move.dst == hash_move->dst)
+            key = 0xffffffffu;
+        else if(captured)
+        {
+            // a piece worth at least the capturer wins its own value or more
+            gain = see(ENGINE_ARG_ MOVE_SQUARE(move.src), MOVE_SQUARE(move.dst));
+            if(gain >= 0)
+                key = 0xf0000000u + ((unsigned int)gain << 12) + see_values[captured & 7];
+            else
+            {
+                key = 0x8000 + gain;
+                ++losing;
+            }
+        }
+        else if(move.src == killers[0].src && move.dst == killers[0].dst)
+            key = 0xe0000001u;
+        else if(move.src == killers[1].src && move.dst == killers[1].dst)
+            key = 0xe0000000u;
+        else
+        {
+            key = ENG.history[MOVE_SQUARE(move.src)][MOVE_SQUARE(move.dst)] + 0x10000;
+            if(key > 0xdfffffffu)
+                key = 0xdfffffffu;
+        }
+
+        // insertion sort, the lists are short
+        for(i = m; i && keys[i - 1] < key; i--)
+        {
+            keys[i] = keys[i - 1];
+            list[i] = list[i - 1];
+        }
+        keys[i] = key;
+        list[i] = move;
+    }
+
+    return count - losing;
+}
+
+// a quiet move caused a beta cutoff
+void record_cutoff(ENGINE_PARAM_ struct move *move, int depth)
+{
+    struct move *killers = ENG.killers[ENG.ply];
+
+    if(killers[0].src != move->src || killers[0].dst != move->dst)
+    {
+        killers[1] = killers[0];
+        killers[0] = *move;
+    }
+
+    ENG.history[MOVE_SQUARE(move->src)][MOVE_SQUARE(move->dst)] += depth * depth;
+}
+
+#endif
+
+#if ENGINE_OVERLAY
+#pragma rodata-name(pop)
+#pragma code-name(pop)
+#endif
+
+// Rights a move keeps, by the squares it leaves and lands on: anything
+// moving off or onto a king or rook square ends the castling that needs it.
+static const unsigned char castle_keep[128] = {
+     7, 15, 15, 15,  3, 15, 15, 11,   15, 15, 15, 15, 15, 15, 15, 15,
+    15, 15, 15, 15, 15, 15, 15, 15,   15, 15, 15, 15, 15, 15, 15, 15,
+    15, 15, 15, 15, 15, 15, 15, 15,   15, 15, 15, 15, 15, 15, 15, 15,
+    15, 15, 15, 15, 15, 15, 15, 15,   15, 15, 15, 15, 15, 15, 15, 15,
+    15, 15, 15, 15, 15, 15, 15, 15,   15, 15, 15, 15, 15, 15, 15, 15,
+    15, 15, 15, 15, 15, 15, 15, 15,   15, 15, 15, 15, 15, 15, 15, 15,
+    15, 15, 15, 15, 15, 15, 15, 15,   15, 15, 15, 15, 15, 15, 15, 15,
+    13, 15, 15, 15, 12, 15, 15, 14,   15, 15, 15, 15, 15, 15, 15, 15
+};
+
+// the castling rights the kings and rooks on the board still allow
+unsigned char castle_allowed(ENGINE_PARAM)
+{
+    unsigned char rights = 0;
+
+    if(ENG.board[0x74] == 11)
+    {
+        if(ENG.board[0x77] == 14) rights |= CASTLE_WK;
+        if(ENG.board[0x70] == 14) rights |= CASTLE_WQ;
+    }
+    if(ENG.board[0x04] == 19)
+    {
+        if(ENG.board[0x07] == 22) rights |= CASTLE_BK;
+        if(ENG.board[0x00] == 22) rights |= CASTLE_BQ;
+    }
+
+    return rights;
+}
+
+// Castling, en passant and under-promotions of side, added after the count
+// moves GenerateMoves() left in list; the generators only make plain moves, and
+// promote to a queen.  Returns the new count.  Castling needs the king out of
+// check and the square it passes unattacked; the square it lands on is left
+// to the next ply, which takes the king if it can.
+unsigned char generate_special(ENGINE_PARAM_ int side, struct move *list, unsigned char count)
+{
+    int king = (side == 8) ? 0x74 : 0x04;
+    int pawn = (side == 8) ? 9 : 18;
+    int forward = (side == 8) ? -16 : 16;
+    int enemy = 24 - side;
+    int src, dst, i;
+    unsigned char type;
+
+    if(ENG.castle & ((side == 8) ? CASTLE_WK | CASTLE_WQ : CASTLE_BK | CASTLE_BQ)
+        && see_attacker(ENGINE_ARG_ king, enemy) < 0)
+    {
+        if((ENG.castle & ((side == 8) ? CASTLE_WK : CASTLE_BK)) && !ENG.board[king + 1] && !ENG.board[king + 2]
+            && see_attacker(ENGINE_ARG_ king + 1, enemy) < 0)
+        {
+            list[count].src = king | MOVE_CASTLE;
+            list[count++].dst = king + 2;
+        }
+
+        if((ENG.castle & ((side == 8) ? CASTLE_WQ : CASTLE_BQ)) && !ENG.board[king - 1] && !ENG.board[king - 2]
+            && !ENG.board[king - 3] && see_attacker(ENGINE_ARG_ king - 1, enemy) < 0)
+        {
+            list[count].src = king | MOVE_CASTLE;
+            list[count++].dst = king - 2;
+        }
+    }
+
+    // the pawns beside the one that has just moved two squares
+    if(ENG.ep != NO_EP)
+    {
+        for(i = -1; i <= 1; i += 2)
+        {
+            src = ENG.ep - forward + i;
+            if(!(src & 0x88) && ENG.board[src] == pawn)
+            {
+                list[count].src = src | MOVE_EP;
+                list[count++].dst = ENG.ep;
+            }
+        }
+    }
+
+    for(src = (side == 8) ? 0x10 : 0x60; !(src & 8); src++)
+    {
+        if(ENG.board[src] != pawn)
+            continue;
+
+        for(dst = src + forward - 1; dst <= src + forward + 1; dst++)
+        {
+            if((dst & 0x88) || ((dst == src + forward) ? ENG.board[dst] != 0 : !(ENG.board[dst] & enemy)))
+                continue;
+
+            for(type = 4; type < 7; type++)
+            {
+                list[count].src = src | MOVE_PROMOTE;
+                list[count++].dst = dst | PROMOTION_BITS(type);
+            }
+        }
+    }
+
+    return count;
+}
+
+// Play move on the board, for either side.  Castling moves the rook as well,
+// en passant takes the pawn beside dst, and a pawn reaching the last row
+// becomes a queen or the piece the move names.  Only the common case runs
+// for a plain move: the flags and the castling rights are tested once each.
+// What cannot be worked out again goes on the undo stack.
+void make_move(ENGINE_PARAM_ struct move move)
+{
+    struct undo *undo = &ENG.undo_stack[ENG.undo_sp++];
+    unsigned char flag = MOVE_FLAG(move);
+    int src = MOVE_SQUARE(move.src), dst = MOVE_SQUARE(move.dst);
+    int piece = ENG.board[src], captured = ENG.board[dst];
+    int sq, rook;
+
+    undo->piece = piece;
+    undo->captured = captured;
+    undo->castle = ENG.castle;
+    undo->ep = ENG.ep;
+    undo->pawn_key = ENG.pawn_key;
+    undo->fifty = ENG.fifty;
+    ENG.rep_ring[ENG.rep_sp++ & (REP_RING - 1)] = REP_KEY;
+#ifdef ENGINE_HASH
+    undo->hash = ENG.hash;
+    if(ENG.ep != NO_EP)
+        ENG.hash ^= zobrist_ep[ENG.ep & 7];
+#else
+    undo->piece_key = ENG.piece_key;
+#endif
+
+    ENG.board[src] = 0;
+    ENG.board[dst] = piece;
+    ENG.ep = NO_EP;
+
+    if((piece & 7) < 3)
+    {
+        ENG.pawn_key ^= pawn_keys[piece >> 4][PAWN_INDEX(src)];
+
+        if(dst < 8 || dst >= 112)
+            ENG.board[dst] = (flag == MOVE_PROMOTE) ? (piece & 24) | PROMOTION_TYPE(move) : piece | 7;
+        else
+        {
+            ENG.pawn_key ^= pawn_keys[piece >> 4][PAWN_INDEX(dst)];
+
+            if(flag == MOVE_EP)
+            {
+                sq = (src & 0x70) | (dst & 7);
+                captured = ENG.board[sq];
+                ENG.board[sq] = 0;
+                ENG.pawn_key ^= pawn_keys[captured >> 4][PAWN_INDEX(sq)];
+                BB_LIFT(sq, captured);
+#ifdef ENGINE_HASH
+                ENG.hash ^= zobrist[captured][sq];
+#endif
+                captured = 0;
+            }
+            else if(dst - src == 32 || src - dst == 32)
             {
-                if(pce = board[sq])
+                // only worth a square when a pawn stands ready to take
+                sq = (src + dst) >> 1;
+                if((!((dst + 1) & 0x88) && ENG.board[dst + 1] == (piece ^ 27))
+                    || (!((dst - 1) & 0x88) && ENG.board[dst - 1] == (piece ^ 27)))
                 {
-                    mat_score += piece_weights[pce & 15]; // material score
-                    (pce & 8) ? (pos_score += board[sq + 8]) : (pos_score -= board[sq + 8]); // positional score
+                    ENG.ep = sq;
+#ifdef ENGINE_HASH
+                    ENG.hash ^= zobrist_ep[sq & 7];
+#endif
                 }
             }
         }
-    
-        eval = mat_score + pos_score;
+    }
+    else if(flag == MOVE_CASTLE)
+    {
+        sq = (dst > src) ? src + 3 : src - 4;
+        rook = ENG.board[sq];
+        ENG.board[sq] = 0;
+        ENG.board[(src + dst) >> 1] = rook;
+        BB_TOGGLE(sq, (src + dst) >> 1, rook, 0);
+#ifdef ENGINE_HASH
+        ENG.hash ^= zobrist[rook][sq] ^ zobrist[rook][(src + dst) >> 1];
+#endif
+    }
+
+    if(captured && (captured & 7) < 3)
+        ENG.pawn_key ^= pawn_keys[captured >> 4][PAWN_INDEX(dst)];
+
+    if(ENG.castle)
+    {
+        ENG.castle &= castle_keep[src] & castle_keep[dst];
+#ifdef ENGINE_HASH
+        ENG.hash ^= zobrist_castle[undo->castle] ^ zobrist_castle[ENG.castle];
+#endif
+    }
+
+    BB_TOGGLE(src, dst, piece, captured);
+
+    // a move that cannot be taken back starts the count again; the key
+    // needs no more than the piece that moved until then
+    if((piece & 7) < 3 || captured || ENG.castle != undo->castle)
+        ENG.fifty = 0;
+    else
+    {
+        ++ENG.fifty;
+#ifndef ENGINE_HASH
+        ENG.piece_key ^= PIECE_KEY(piece, src) ^ PIECE_KEY(piece, dst);
+#endif
+    }
+
+#ifdef ENGINE_HASH
+    ENG.hash ^= zobrist[piece][src] ^ zobrist[captured][dst] ^ zobrist[ENG.board[dst]][dst] ^ zobrist_side;
+#endif
+}
+
+// take back the last move made, which must be move
+void unmake_move(ENGINE_PARAM_ struct move move)
+{
+    struct undo *undo = &ENG.undo_stack[--ENG.undo_sp];
+    unsigned char flag = MOVE_FLAG(move);
+    int src = MOVE_SQUARE(move.src), dst = MOVE_SQUARE(move.dst);
+    int sq, rook;
+
+    if(flag == MOVE_EP)
+    {
+        sq = (src & 0x70) | (dst & 7);
+        ENG.board[sq] = undo->piece ^ 27;
+        BB_LIFT(sq, undo->piece ^ 27);
+    }
+    else if(flag == MOVE_CASTLE)
+    {
+        sq = (dst > src) ? src + 3 : src - 4;
+        rook = ENG.board[(src + dst) >> 1];
+        BB_TOGGLE(sq, (src + dst) >> 1, rook, 0);
+        ENG.board[(src + dst) >> 1] = 0;
+        ENG.board[sq] = rook;
+    }
 
-        return (side == 8) ? eval : -eval;   // here returns current position's score
+    BB_TOGGLE(src, dst, undo->piece, undo->captured);
+    ENG.board[dst] = undo->captured;
+    ENG.board[src] = undo->piece;
+
+    ENG.castle = undo->castle;
+    ENG.ep = undo->ep;
+    ENG.pawn_key = undo->pawn_key;
+    ENG.fifty = undo->fifty;
+    --ENG.rep_sp;
+#ifdef ENGINE_HASH
+    ENG.hash = undo->hash;
+#else
+    ENG.piece_key = undo->piece_key;
+#endif
+}
+
+#if ENGINE_OVERLAY
+#pragma code-name(push, "OVERLAY1")
+#pragma rodata-name(push, "OVERLAY1")
+#endif
+
+// A draw: the position has been seen before since the last irreversible
+// move, as far back as the ring reaches, or fifty moves went without one
+// and side to move is not in check, which could be mate.
+unsigned char is_draw(ENGINE_PARAM_ int side)
+{
+    unsigned int back = ENG.fifty, k;
+
+    if(ENG.fifty >= 100)
+        return !king_attacked(ENGINE_ARG_ side);
+
+    if(back > ENG.rep_sp)
+        back = ENG.rep_sp;
+    if(back > REP_RING - MAX_PLY)
+        back = REP_RING - MAX_PLY;
+
+    // the same side to move, and at least two moves each in between
+    for(k = 4; k <= back; k += 2)
+    {
+        if(ENG.rep_ring[(ENG.rep_sp - k) & (REP_RING - 1)] == REP_KEY)
+            return 1;
     }
 
+    return 0;
+}
+
+// a move of the game rather than of a search, for the side to move
+void play_move(ENGINE_PARAM_ struct move move)
+{
+    make_move(ENGINE_ARG_ move);
+    --ENG.undo_sp;
+    ENG.side = 24 - ENG.side;
+}
+
+// Leaf positions depth plies ahead, not counting any that leave a king to be
+// taken: the standard perft figures (startpos up to depth 4: 20, 400, 8902,
+// 197281).  depth must stay below MAX_PLY.
+unsigned long Perft(ENGINE_PARAM_ unsigned char side, unsigned char depth)
+{
+    struct move *list = &ENG.move_stack[ENG.move_sp];
+    unsigned long nodes = 0;
+    unsigned char count, m;
 
+    count = GenerateMoves(ENGINE_ARG_ side, list);
+    if(count == KING_CAPTURE)
+        return 0;
+    if(!depth)
+        return 1;
+
+    count = generate_special(ENGINE_ARG_ side, list, count);
+    ENG.move_sp += count;
+
+    for(m = 0; m < count; m++)
+    {
+        make_move(ENGINE_ARG_ list[m]);
+        nodes += Perft(ENGINE_ARG_ 24 - side, depth - 1);
+        unmake_move(ENGINE_ARG_ list[m]);
+    }
+
+    ENG.move_sp -= count;
+    return nodes;
+}
+
+// src to dst, flags and all, is one of side's legal moves; a move that did
+// not come from this position's generator has to pass this to be played
+unsigned char move_is_legal(ENGINE_PARAM_ int side, unsigned char src, unsigned char dst)
+{
+    struct move *list = &ENG.move_stack[ENG.move_sp];
+    unsigned char count, m, legal;
+
+    count = GenerateMoves(ENGINE_ARG_ side, list);
+    if(count == KING_CAPTURE)
+        return 0;
+    count = generate_special(ENGINE_ARG_ side, list, count);
+
+    for(m = 0; m < count; m++)
+    {
+        if(list[m].src == src && list[m].dst == dst)
+        {
+            make_move(ENGINE_ARG_ list[m]);
+            legal = !king_attacked(ENGINE_ARG_ side);
+            unmake_move(ENGINE_ARG_ list[m]);
+            return legal;
+        }
+    }
+
+    return 0;
+}
+
+// Keep a root move with the line its search just returned among the best
+// ENG.multipv.  Returns the score the next one has to beat: old_alpha until
+// the list is full, the last one's after.
+int root_insert(ENGINE_PARAM_ struct move move, int score, int old_alpha)
+{
+    struct root_move *entry;
+    unsigned char i, j;
+
+    i = (ENG.root_count < ENG.multipv) ? ENG.root_count++ : ENG.multipv - 1;
+    for(; i && ENG.root_moves[i - 1].score < score; i--)
+        ENG.root_moves[i] = ENG.root_moves[i - 1];
+
+    entry = &ENG.root_moves[i];
+    entry->move = entry->pv[0] = move;
+    entry->score = score;
+    for(j = 1; j < ENG.pv_length[1]; j++)
+        entry->pv[j] = ENG.pv[1][j];
+    entry->pv_length = j;
+
+    return (ENG.root_count < ENG.multipv) ? old_alpha : ENG.root_moves[ENG.multipv - 1].score;
+}
+
+int SearchPosition(ENGINE_PARAM_ int side, int depth, int alpha, int beta)
+{
+    int old_alpha;
+    struct move move, best_move;
+    int score = -KING_TAKEN;
+
+    struct move *list;
+    unsigned char count, searched, m;
+    unsigned char moves_searched = 0;
+    unsigned char legal = 0;
+    unsigned char in_check = 0;
+    unsigned char i;
+#ifdef ENGINE_HASH
+    struct move hash_move;
+    int hashed;
+    int captured_piece;
+#endif
+
+    ENG.pv_length[ENG.ply] = ENG.ply;
+
+    if(!((unsigned int)++ENG.stats.nodes & PROGRESS_MASK) && ENG.search_progress)
+        ENG.search_progress(ENGINE_ARG);
+
+    // the root has to move, below it a draw is settled
+    if(ENG.ply && is_draw(ENGINE_ARG_ side))
+        return 0;
+
+    // callers start at ply 0 with any position
+    if(!ENG.ply)
+    {
+        ENG.pawn_key = pawn_key(ENGINE_ARG);
+        ENG.root_count = 0;
+    }
+
+    // a side in check gets a ply more to answer it, as far as the PV reaches
+    if(depth && (in_check = king_attacked(ENGINE_ARG_ side)) && ENG.ply + depth < MAX_PLY - 1)
+        ++depth;
+
+    if(!depth)
+    {
+        ++ENG.stats.evals;
+
+        // Evaluate position
+        return (side == 8) ? EvaluateWhite(ENGINE_ARG) + evaluate_terms(ENGINE_ARG)
+                           : EvaluateBlack(ENGINE_ARG) - evaluate_terms(ENGINE_ARG);   // here returns current position's score
+    }
+
+
+
+#ifdef ENGINE_HASH
+    if(ENG.tt)
+    {
+        // callers start at ply 0 with any position and side
+        if(!ENG.ply)
+            ENG.hash = hash_position(ENGINE_ARG_ side);
+
+        hash_move.src = hash_move.dst = 0xff;
+        if((hashed = tt_probe(ENGINE_ARG_ depth, alpha, beta, &hash_move)) != TT_MISS)
+        {
+            ++ENG.stats.hash_hits;
+            return hashed;
+        }
+    }
+#endif
 
     // Generate moves
+    list = &ENG.move_stack[ENG.move_sp];
+    count = (side == 8) ? GenerateWhite(ENGINE_ARG_ list) : GenerateBlack(ENGINE_ARG_ list);
+
+    // on king capture; at the root the game is over and there is no move
+    if(count == KING_CAPTURE)
+    {
+        if(!ENG.ply)
+            ENG.best.src = ENG.best.dst = NO_MOVE;
+        return KING_TAKEN;
+    }
+
+    // Mate-distance pruning: no line from here is mated sooner than now or
+    // mates sooner than the next ply, so a window past both is settled.
+    if(ENG.ply)
+    {
+        if(alpha < ENG.ply - MATE)
+            alpha = ENG.ply - MATE;
+        if(beta > MATE - ENG.ply - 1)
+            beta = MATE - ENG.ply - 1;
+        if(alpha >= beta)
+            return alpha;
+    }
+    old_alpha = alpha;
 
-    for(src_square = 0; src_square < 128; src_square++)
+    count = generate_special(ENGINE_ARG_ side, list, count);
+
+#ifdef ENGINE_HASH
+    if(ENG.tt)
+        searched = order_moves(ENGINE_ARG_ list, count, &hash_move);
+    else
+#endif
+    searched = order_captures(ENGINE_ARG_ list, count);
+
+    // One ply from the leaves a losing capture would be scored by the piece
+    // it takes, the recapture is never seen; leave those out below the root.
+    // Until one kept move proves legal the rest are searched too, so a node
+    // is never scored as mate or stalemate for want of them.
+    if(depth > 1 || !ENG.ply || !searched)
+        searched = count;
+
+    ENG.move_sp += count;
+
+    for(m = 0; m < searched || (!legal && m < count); m++)
     {
-        if(!(src_square & 0x88))
+        move = list[m];
+#ifdef ENGINE_HASH
+        captured_piece = ENG.board[MOVE_SQUARE(move.dst)];
+#endif
+
+        make_move(ENGINE_ARG_ move);
+
+        // the root plays legal moves only; below it the next ply finds the
+        // king it can take
+        if(!ENG.ply && king_attacked(ENGINE_ARG_ side))
         {
-            piece = board[src_square];
-                                        
-            if(piece & side)
+            unmake_move(ENGINE_ARG_ move);
+            continue;
+        }
+
+        ++ENG.ply;
+        score = -SearchPosition(ENGINE_ARG_ 24 - side, depth - 1, -beta, -alpha);
+        --ENG.ply;
+        unmake_move(ENGINE_ARG_ move);
+
+        // search abandoned, the caller discards the result
+        if(ENG.search_stop)
+        {
+            ENG.move_sp -= count;
+            return 0;
+        }
+
+        if(score == -KING_TAKEN)
+            continue;
+
+        // any legal move beats having none
+        if(!legal++ && !ENG.ply)
+            ENG.best = move;
+
+        // multi-PV root: no cutoff, every move is tried against the list
+        if(!ENG.ply && ENG.multipv > 1)
+        {
+            if(score > alpha)
+                alpha = root_insert(ENGINE_ARG_ move, score, old_alpha);
+            ++moves_searched;
+            continue;
+        }
+
+        // alpha-beta stuff
+        if(score > alpha)
+        {
+            if(score >= beta)
             {
-                type = piece & 7;
-                directions = move_offsets[type + 30];
-                
-                while(step_vector = move_offsets[++directions])
+                ++ENG.stats.cutoffs;
+                if(!moves_searched)
+                    ++ENG.stats.first_cutoffs;
+#ifdef ENGINE_HASH
+                if(ENG.tt)
                 {
-                    dst_square = src_square;
-                    
-                    do
-                    {
-                        dst_square += step_vector;
-                        captured_square = dst_square;
-                        
-                        if(dst_square & 0x88) break;
-    
-                        captured_piece = board[captured_square];                        
-    
-                        if(captured_piece & side) break;
-                        if(type < 3 && !(step_vector & 7) != !captured_piece) break;
-                        if((captured_piece & 7) == 3) return 10000;    // on king capture
-                        
-                        // make move
-                        board[captured_square] = 0;
-                        board[src_square] = 0;
-                        board[dst_square] = piece;
-
-                        // pawn promotion
-                        if(type < 3)
-                        {
-                            if(dst_square + step_vector + 1 & 0x80)
-                                board[dst_square]|=7;
-                        }
-                        
-                        score = -SearchPosition(24 - side, depth - 1, -beta, -alpha);
-                                              
-                        // take back
-                        board[dst_square] = 0;
-                        board[src_square] = piece;
-                        board[captured_square] = captured_piece;
-
-                        //Needed to detect checkmate
-                        best_src = src_square;
-                        best_dst = dst_square;
-
-                        // alpha-beta stuff
-                        if(score > alpha)
-                        {
-                            if(score >= beta)
-                                return beta;
-                            
-                            alpha = score;
-        
-                            temp_src = src_square;
-                            temp_dst = dst_square;
-                        }              
-                        
-                        captured_piece += type < 5;
-                        
-                        if(type < 3 & 6*side + (dst_square & 0x70) == 0x80)captured_piece--;  
-                    }
-    
-                    while(!captured_piece);
+                    if(!captured_piece)
+                        record_cutoff(ENGINE_ARG_ &move, depth);
+                    tt_store(ENGINE_ARG_ depth, beta, TT_LOWER, move);
                 }
+#endif
+                ENG.move_sp -= count;
+                return beta;
             }
+
+            alpha = score;
+
+            best_move = move;
+
+            // extend the principal variation with the child's line
+            ENG.pv[ENG.ply][ENG.ply] = move;
+            for(i = ENG.ply + 1; i < ENG.pv_length[ENG.ply + 1]; i++)
+                ENG.pv[ENG.ply][i] = ENG.pv[ENG.ply + 1][i];
+            ENG.pv_length[ENG.ply] = ENG.pv_length[ENG.ply + 1];
         }
+
+        ++moves_searched;
+    }
+
+    ENG.move_sp -= count;
+
+    // no legal move: mated here, or stalemate
+    if(!legal)
+    {
+        if(!ENG.ply)
+            ENG.best.src = ENG.best.dst = NO_MOVE;
+        return in_check ? ENG.ply - MATE : 0;
+    }
+
+    // the best of the list is the search's result and line
+    if(!ENG.ply && ENG.multipv > 1 && ENG.root_count)
+    {
+        best_move = ENG.root_moves[0].move;
+        alpha = ENG.root_moves[0].score;
+        for(i = 0; i < ENG.root_moves[0].pv_length; i++)
+            ENG.pv[0][i] = ENG.root_moves[0].pv[i];
+        ENG.pv_length[0] = i;
     }
 
     // store the best move
     if(alpha != old_alpha)
+        ENG.best = best_move;
+
+#ifdef ENGINE_HASH
+    if(ENG.tt)
     {
-        best_src = temp_src;
-        best_dst = temp_dst;
+        if(alpha != old_alpha)
+            tt_store(ENGINE_ARG_ depth, alpha, TT_EXACT, best_move);
+        else
+        {
+            best_move.src = best_move.dst = 0xff;
+            tt_store(ENGINE_ARG_ depth, alpha, TT_UPPER, best_move);
+        }
     }
+#endif
 
     return alpha;   // here returns the best score
 }
 
-void playerMove()
+#ifndef ENGINE_REENTRANT
+
+//*********************************************************************************
+//
+// BMCP behind the engine interface of geochess-engine.h.  ENG.side is the
+// side to move.
+//
+//********************************************************************************
+
+// UI piece codes to BMCP pieces
+static const unsigned char bmcp_pieces[13] = { 0, 11, 15, 13, 12, 14, 9, 19, 23, 21, 20, 22, 18 };
+
+// Results of earlier searches, by position.  A search finds its position
+// here when it was searched at least as deep before and plays the stored
+// move without searching.  The UI keeps the table on disk between sessions.
+#ifndef LEARN_ENTRIES
+#define LEARN_ENTRIES   128         // a power of two
+#endif
+
+struct learn_entry {
+    unsigned long key;              // 0 = unused
+    struct chess_move move;
+    int score;
+    unsigned char depth;
+};
+
+struct learn_entry learn_table[LEARN_ENTRIES];
+unsigned long learn_key;            // of the position being searched
+
+// key of the position, the side to move, castling and en passant
+unsigned long bmcp_key(void)
 {
-        // usermove must contain a chess notation value (eg.  c2c4)
-        user_move[4] = 0;
-        for(sq = 0; sq < 128; sq++)
-        {
-            if(!(sq & 0x88))
-            {
-                if(!strncmp(user_move, notation[sq], 2))
-                    user_src = sq;
+    unsigned long key = ENG.side ^ (ENG.castle << 8) ^ ((unsigned long)ENG.ep << 16);
+    unsigned char sq;
 
-                if(!strncmp(user_move + 2, notation[sq], 2))
-                    user_dst = sq;
-            }
-        }
-        
-        // make user move
-        board[user_dst] = board[user_src];
-        board[user_src] = 0;
+    for(sq = 0; sq < 128; sq++)
+    {
+        if(!(sq & 0x88))
+            key = ((key << 5) + key) ^ ENG.board[sq];
+    }
 
-        // if pawn promotion
-    //    if(((board[user_dst] == 9) && (user_dst >= 0 && user_dst <= 7)) ||
-    //       ((board[user_dst] == 18) && (user_dst >= 112 && user_dst <= 119)))
-     //       board[user_dst] |= 7;
-        
+    return key;
 }
 
-unsigned char aiMove()
+void bmcp_init(void)
 {
-    // aimove[5] - updates a global zero terminated string
+    engine_init();
+}
 
-    side = 24 - side;   // change side
-            
-    score = SearchPosition(side, depth, -10000, 10000);
+void bmcp_set_position(unsigned char *squares, unsigned char side)
+{
+    unsigned char sq;
 
-    // make AI move
-    board[best_dst] = board[best_src];
-    board[best_src] = 0;
+    for(sq = 0; sq < 128; sq++)
+    {
+        if(!(sq & 0x88))
+            ENG.board[sq] = bmcp_pieces[*squares++];
+    }
 
-    // if pawn promotion
-   // if(((board[best_dst] == 9) && (best_dst >= 0 && best_dst <= 7)) ||
-    //    ((board[best_dst] == 18) && (best_dst >= 112 && best_dst <= 119)))
-    //    board[best_dst] |= 7;
+    ENG.side = (side == WHT) ? 8 : 16;
+    ENG.castle = castle_allowed();
+    ENG.ep = NO_EP;
+    history_reset();
+}
+
+void bmcp_make_user_move(struct chess_move *move)
+{
+    struct move m;
 
-    side = 24 - side;    // change side
+    m.src = move->src;
+    m.dst = move->dst;
+    play_move(m);               // and change side
+}
 
-    // Checkmate detection
-    if(score == 10000 || score == -10000) { return 1;}
+void bmcp_start_search(void)
+{
+    engine_stats_reset(ENG.depth);
+    learn_key = bmcp_key();
+}
 
-    strcpy(ai_move, notation[best_src]);
-    strcat(ai_move, notation[best_dst]);
+// The recursive search cannot stop halfway, so all of it runs in the first
+// poll.  search_progress keeps the display going meanwhile.
+unsigned char bmcp_poll_search(void)
+{
+    struct learn_entry *entry = &learn_table[(unsigned int)(learn_key ^ (learn_key >> 16)) & (LEARN_ENTRIES - 1)];
 
-    return 0;
+    // a learned move, if it is deep enough and legal here: another position
+    // may share the key, or another build may have written the table
+    if(entry->key == learn_key && entry->depth >= ENG.depth
+        && move_is_legal(ENG.side, entry->move.src, entry->move.dst))
+    {
+        ENG.best.src = ENG.pv[0][0].src = entry->move.src;
+        ENG.best.dst = ENG.pv[0][0].dst = entry->move.dst;
+        ENG.pv_length[0] = 1;
+        ENG.score = entry->score;
+        ENG.stats.depth = entry->depth;
+        ++ENG.stats.hash_hits;
+        engine_stats_finish();
+
+        return SEARCH_DONE;
+    }
+
+    ENG.score = SearchPosition(ENG.side, ENG.depth, -KING_TAKEN, KING_TAKEN);
+    engine_stats_finish();
+
+    // replaces the entry unless it holds this position searched deeper;
+    // a position without a move, or with a king to take, is not kept
+    if(ENG.best.src != NO_MOVE && ENG.score != KING_TAKEN && (entry->key != learn_key || entry->depth <= ENG.depth))
+    {
+        entry->key = learn_key;
+        entry->move.src = ENG.best.src;
+        entry->move.dst = ENG.best.dst;
+        entry->score = ENG.score;
+        entry->depth = ENG.depth;
+    }
+
+    return SEARCH_DONE;
 }
 
-unsigned char xlateCol(unsigned char x)
+// The best moves of the side to move, up to max of them (2 to MULTIPV_MAX),
+// best first with their scores, from one multi-PV search at the playing
+// depth.  Moves that lose the king are left out.  Returns how many.
+unsigned char bmcp_hint(struct chess_move *moves, int *scores, unsigned char max)
 {
-    unsigned char c;
+    unsigned char i;
 
-    switch(x)
+    engine_stats_reset(ENG.depth);
+    ENG.multipv = max;
+    SearchPosition(ENG.side, ENG.depth, -KING_TAKEN, KING_TAKEN);
+    ENG.multipv = 0;
+    engine_stats_finish();
+
+    for(i = 0; i < ENG.root_count; i++)
     {
-        case 'a': { c=0; break; }
-        case 'b': { c=1; break; }
-        case 'c': { c=2; break; }
-        case 'd': { c=3; break; }
-        case 'e': { c=4; break; }
-        case 'f': { c=5; break; }
-        case 'g': { c=6; break; }
-        case 'h': { c=7; break; }
+        moves[i].src = ENG.root_moves[i].move.src;
+        moves[i].dst = ENG.root_moves[i].move.dst;
+        scores[i] = ENG.root_moves[i].score;
     }
 
-    return c;
+    return i;
 }
 
-unsigned char xlateRow(unsigned char x)
+unsigned char bmcp_get_best_move(struct chess_move *move)
 {
-    unsigned char r;
+    // a king to take, mated, or stalemate
+    if(ENG.score == KING_TAKEN || ENG.best.src == NO_MOVE)
+        return ENG.score ? MOVE_NONE : MOVE_STALEMATE;
+
+    move->src = ENG.best.src;
+    move->dst = ENG.best.dst;
+    bmcp_make_user_move(move);
+
+    return MOVE_FOUND;
+}
+
+#endif
+
+#if ENGINE_OVERLAY
+#pragma rodata-name(pop)
+#pragma code-name(pop)
+#endif
 
-    switch(x)
+#ifndef ENGINE_REENTRANT
+
+// resident: the search log asks for it with the engine's overlay unloaded
+unsigned char bmcp_get_pv(struct chess_move *line, unsigned char max)
+{
+    unsigned char i;
+
+    for(i = 0; i < ENG.pv_length[0] && i < max; i++)
     {
-        case '1': { r=7; break; }
-        case '2': { r=6; break; }
-        case '3': { r=5; break; }
-        case '4': { r=4; break; }
-        case '5': { r=3; break; }
-        case '6': { r=2; break; }
-        case '7': { r=1; break; }
-        case '8': { r=0; break; }
+        line[i].src = ENG.pv[0][i].src;
+        line[i].dst = ENG.pv[0][i].dst;
     }
 
-    return r;
+    return i;
 }
 
-#endif
\ No newline at end of file
+struct chess_engine bmcp_engine = {
+    "BMCP", ENGINE_OVERLAY,
+    bmcp_init, bmcp_set_position, bmcp_make_user_move,
+    bmcp_start_search, bmcp_poll_search, bmcp_get_best_move,
+    bmcp_get_pv, &engine.stats,
+    learn_table, sizeof(learn_table)
+};
+
+#endif
+
+#endif
@@ -0,0 +1,258 @@
+//===================================================================================
+//
+//                                  GEOCHESS
+//
+// geoChess is a chess game for GEOS under the Commodore 64 and 128 computers
+//
+// Written by Scott Hutter
+// Nov 2023
+//
+// You are free to modify this code as desired, as long as original author credit
+// is mentioned for both the geos code and the included AI engines
+//===================================================================================
+
+//*********************************************************************************
+//
+// Engine kernel benchmark for the GEOS build's engine, built natively with
+// any C compiler (build-host.sh does).  perft, eval and search print counts
+// and results that a change to the move generator or evaluator must leave
+// as they are; time them from outside.  "rules" checks the game-ending
+// answers of BMCP's and Tiny's engine interfaces; it exits with 1 when one
+// is wrong.
+//
+// geochess-bench [perft | eval | search | rules]
+//
+//********************************************************************************
+
+#include <stdio.h>
+#include <string.h>
+
+// the printed results must not depend on the clock
+#define ENGINE_TICKS()          0UL
+#define ENGINE_TICKS_PER_SEC    1UL
+
+#include "geochess-ai.h"
+#include "geochess-tiny.h"
+
+// Italian game after 1.e4 e5 2.Nf3 Nc6 3.Bc4 Nf6, white to move
+char *middlegame = "r1bqkb1r/pppp1ppp/2n2n2/4p3/2B1P3/5N2/PPPP1PPP/RNBQK2R";
+
+// piece placement field of a FEN; the positional columns stay as they are
+void load_position(char *placement)
+{
+    static char pieces[] = "PKNBRQpknbrq";
+    static char values[] = { 9, 11, 12, 13, 14, 15, 18, 19, 20, 21, 22, 23 };
+    unsigned char sq = 0;
+    unsigned char n;
+    char *p;
+
+    for(; *placement; placement++)
+    {
+        if(*placement == '/')
+            sq = (sq & 0x70) + 16;
+        else if(*placement >= '1' && *placement <= '8')
+        {
+            for(n = *placement - '0'; n; n--)
+                engine.board[sq++] = 0;
+        }
+        else if((p = strchr(pieces, *placement)))
+            engine.board[sq++] = values[p - pieces];
+    }
+
+    engine.castle = castle_allowed();
+}
+
+// the same placement as the UI's board squares, a8 first
+void load_squares(char *placement, unsigned char *squares)
+{
+    static char pieces[] = "KQBNRPkqbnrp";
+    unsigned char n;
+    char *p;
+
+    for(; *placement; placement++)
+    {
+        if(*placement >= '1' && *placement <= '8')
+        {
+            for(n = *placement - '0'; n; n--)
+                *squares++ = EMPTY;
+        }
+        else if((p = strchr(pieces, *placement)))
+            *squares++ = (unsigned char)(p - pieces) + 1;
+    }
+}
+
+void perft(void)
+{
+    engine_init();
+    printf("startpos perft 3: %lu\n", Perft(8, 3));
+
+    load_position(middlegame);
+    printf("middlegame perft 2: %lu\n", Perft(8, 2));
+}
+
+void eval(void)
+{
+    unsigned int i;
+    int score;
+
+    engine_init();
+    load_position(middlegame);
+
+    for(i = 0; i < 1000; i++)
+        score = Evaluate();
+
+    printf("middlegame eval x1000: %d\n", score);
+}
+
+void search(void)
+{
+    engine_init();
+    engine_stats_reset(3);
+    engine.score = SearchPosition(8, 3, -KING_TAKEN, KING_TAKEN);
+    printf("startpos depth 3: %d %s%s %lu nodes\n", engine.score,
+        notation[MOVE_SQUARE(engine.best.src)], notation[MOVE_SQUARE(engine.best.dst)], engine.stats.nodes);
+
+    load_position(middlegame);
+    engine_stats_reset(3);
+    engine.score = SearchPosition(8, 3, -KING_TAKEN, KING_TAKEN);
+    printf("middlegame depth 3: %d %s%s %lu nodes\n", engine.score,
+        notation[MOVE_SQUARE(engine.best.src)], notation[MOVE_SQUARE(engine.best.dst)], engine.stats.nodes);
+}
+
+// One search through the engine interface from placement with side to
+// move, set through the interface after a search of the starting position
+// has left a best move behind.  Prints the move or result and returns 1 if
+// it is not expected; dst is only compared when a move is expected.
+int rule(char *name, char *placement, int side, unsigned char expected, unsigned char dst)
+{
+    struct chess_move move;
+    struct learn_entry *entry;
+    unsigned char squares[64];
+    unsigned char result;
+
+    bmcp_init();
+    bmcp_start_search();
+    bmcp_poll_search();
+
+    // as if set up late in a long game: none of its history may count
+    engine.fifty = engine.rep_sp = 100;
+    load_squares(placement, squares);
+    bmcp_set_position(squares, (side == 8) ? WHT : BLK);
+    if(engine.fifty || engine.rep_sp)
+    {
+        printf("%-12s history kept\n", name);
+        return 1;
+    }
+
+    bmcp_start_search();
+    bmcp_poll_search();
+    result = bmcp_get_best_move(&move);
+
+    printf("%-12s %s", name, (result == MOVE_FOUND) ? "move " : (result == MOVE_NONE) ? "over" : "stalemate");
+    if(result == MOVE_FOUND)
+        printf("%s%s", notation[MOVE_SQUARE(move.src)], notation[MOVE_SQUARE(move.dst)]);
+
+    // a game that is over leaves nothing to learn
+    entry = &learn_table[(unsigned int)(learn_key ^ (learn_key >> 16)) & (LEARN_ENTRIES - 1)];
+    if(result != MOVE_FOUND && entry->key == learn_key)
+    {
+        printf(", learned\n");
+        return 1;
+    }
+
+    if(result != expected || (result == MOVE_FOUND && MOVE_SQUARE(move.dst) != dst))
+    {
+        printf(", wrong\n");
+        return 1;
+    }
+
+    printf("\n");
+    return 0;
+}
+
+// A learned move is only played if it is legal: here the entry for the
+// starting position moves the rook through its own pawn.
+int learned(void)
+{
+    struct chess_move move;
+    struct learn_entry *entry;
+
+    bmcp_init();
+    bmcp_start_search();
+    entry = &learn_table[(unsigned int)(learn_key ^ (learn_key >> 16)) & (LEARN_ENTRIES - 1)];
+    entry->key = learn_key;
+    entry->move.src = 0x70;
+    entry->move.dst = 0x40;
+    entry->depth = 99;
+    bmcp_poll_search();
+    bmcp_get_best_move(&move);
+
+    printf("%-12s move %s%s", "learned", notation[MOVE_SQUARE(move.src)], notation[MOVE_SQUARE(move.dst)]);
+    if(MOVE_SQUARE(move.src) == 0x70)
+    {
+        printf(", wrong\n");
+        return 1;
+    }
+
+    printf("\n");
+    return 0;
+}
+
+// the same through the Tiny engine, which has no learn table
+int tiny_rule(char *name, char *placement, int side, unsigned char expected)
+{
+    struct chess_move move;
+    unsigned char squares[64];
+    unsigned char result;
+
+    tiny_init();
+    load_squares(placement, squares);
+    tiny_set_position(squares, (side == 8) ? WHT : BLK);
+    tiny_start_search();
+    while(tiny_poll_search() == SEARCH_RUNNING)
+        ;
+    result = tiny_get_best_move(&move);
+
+    printf("tiny %-12s %s\n", name, (result == MOVE_FOUND) ? "move" : (result == MOVE_NONE) ? "over" : "stalemate");
+    return result != expected;
+}
+
+int rules(void)
+{
+    int failed = 0;
+
+    failed |= rule("mate in 1", "6k1/5ppp/8/8/8/8/5PPP/R5K1", 8, MOVE_FOUND, 0x00);
+    failed |= rule("mated", "k7/1Q6/1K6/8/8/8/8/8", 16, MOVE_NONE, 0);
+    failed |= rule("stalemate", "k7/8/1Q6/8/8/8/8/7K", 16, MOVE_STALEMATE, 0);
+
+    // the player left the king in check: the game is over, the last
+    // search's move must not be played
+    failed |= rule("king to take", "k3q3/8/8/8/8/8/8/4K3", 16, MOVE_NONE, 0);
+
+    failed |= learned();
+
+    failed |= tiny_rule("mated", "k7/1Q6/1K6/8/8/8/8/8", 16, MOVE_NONE);
+    failed |= tiny_rule("stalemate", "k7/8/1Q6/8/8/8/8/7K", 16, MOVE_STALEMATE);
+    failed |= tiny_rule("king to take", "k3q3/8/8/8/8/8/8/4K3", 16, MOVE_NONE);
+
+    return failed;
+}
+
+int main(int argc, char *argv[])
+{
+    if(argc < 2 || !strcmp(argv[1], "perft"))
+        perft();
+    else if(!strcmp(argv[1], "eval"))
+        eval();
+    else if(!strcmp(argv[1], "search"))
+        search();
+    else if(!strcmp(argv[1], "rules"))
+        return rules();
+    else
+    {
+        printf("usage: geochess-bench [perft | eval | search | rules]\n");
+        return 1;
+    }
+
+    return 0;
+}
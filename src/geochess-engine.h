@@ -0,0 +1,163 @@
+//===================================================================================
+//
+//                                  GEOCHESS
+//
+// geoChess is a chess game for GEOS under the Commodore 64 and 128 computers
+//
+// Written by Scott Hutter
+// Nov 2023
+//
+// You are free to modify this code as desired, as long as original author credit
+// is mentioned for both the geos code and the included AI engines
+//===================================================================================
+
+//*********************************************************************************
+//
+// Engine interface.  The user interface only talks to an engine through a
+// struct chess_engine, so several engines can ship in one program and be
+// swapped from the menu.  An engine keeps its own board: the UI tells it the
+// position, the player's moves, and asks for its reply.
+//
+// Squares are 0x88 indices, row * 16 + col, with a8 = 0x00 and h1 = 0x77,
+// the same rows and columns as the UI's board.  Pieces are the UI's codes
+// below.
+//
+//********************************************************************************
+
+#ifndef GEOCHESS_ENGINE_H
+#define GEOCHESS_ENGINE_H
+
+#define EMPTY       0
+#define WHT_KING    1
+#define WHT_QUEEN   2
+#define WHT_BISHOP  3
+#define WHT_KNIGHT  4
+#define WHT_ROOK    5
+#define WHT_PAWN    6
+#define BLK_KING    7
+#define BLK_QUEEN   8
+#define BLK_BISHOP  9
+#define BLK_KNIGHT  10
+#define BLK_ROOK    11
+#define BLK_PAWN    12
+
+#define WHT   0
+#define BLK   1
+
+#define SQUARE(row, col)    (((row) << 4) | (col))
+#define SQUARE_ROW(sq)      ((sq) >> 4)
+#define SQUARE_COL(sq)      ((sq) & 7)
+
+// Search timing.  The GEOS build defines ENGINE_TICKS before including this
+// file so it can read the CIA time-of-day clock; everything else uses clock().
+#ifndef ENGINE_TICKS
+#include <time.h>
+#define ENGINE_TICKS()          ((unsigned long)clock())
+#define ENGINE_TICKS_PER_SEC    ((unsigned long)CLOCKS_PER_SEC)
+#endif
+
+// A move is one 16-bit word: the two squares, and in the 0x88 bits of src,
+// which no square has set, what kind of move it is.  A plain move, a pawn
+// reaching the last row as a queen included, has none of them.  An under-
+// promotion names its piece in the 0x88 bits of dst.  Use MOVE_SQUARE() for
+// the squares of any move that may carry a flag.
+struct chess_move {
+    unsigned char src, dst;
+};
+
+#define MOVE_CASTLE     0x08        // the king's two squares; the rook moves too
+#define MOVE_EP         0x80        // en passant, the pawn taken stands beside dst
+#define MOVE_PROMOTE    0x88        // to the piece in dst's flag bits
+
+#define MOVE_SQUARE(sq)         ((sq) & 0x77)
+#define MOVE_FLAG(move)         ((move).src & 0x88)
+
+// promotion piece of a MOVE_PROMOTE move as a BMCP type: 4 knight .. 7 queen,
+// and the dst bits for one
+#define PROMOTION_TYPE(move)    (4 | (((move).dst >> 3) & 1) | (((move).dst >> 6) & 2))
+#define PROMOTION_BITS(type)    ((((type) & 1) << 3) | (((type) & 2) << 6))
+
+struct search_stats {
+    unsigned long nodes;            // positions visited
+    unsigned long evals;            // leaf evaluations
+    unsigned long cutoffs;          // beta cutoffs
+    unsigned long first_cutoffs;    // beta cutoffs caused by the first move tried
+    unsigned long hash_hits;        // transposition table hits
+    unsigned long start;            // ticks when the search began
+    unsigned long elapsed;          // ticks spent in the search
+    unsigned char depth;            // depth of the search
+};
+
+// poll_search() results
+#define SEARCH_RUNNING  0
+#define SEARCH_DONE     1
+
+// get_best_move() results
+#define MOVE_FOUND      0
+#define MOVE_NONE       1           // the game is over, one of the kings is lost
+#define MOVE_STALEMATE  2           // no legal move, and not in check: a draw
+
+struct chess_engine {
+    char *name;                     // shown in the status line
+    unsigned char overlay;          // VLIR record holding the code (GEOS), 0 if resident
+
+    // a new game from the starting position, white to move
+    void (*init)(void);
+
+    // 64 piece codes from a8 to h1, and WHT or BLK to move.  Kings and rooks
+    // on their starting squares may castle; there is no en passant square.
+    void (*set_position)(unsigned char *squares, unsigned char side);
+
+    // the player's move, already checked by the UI and flagged as castling,
+    // en passant or under-promotion where it is one
+    void (*make_user_move)(struct chess_move *move);
+
+    // search for the side to move.  poll_search() does a slice of the work
+    // per call and returns SEARCH_RUNNING until the search is over, so the
+    // UI can redraw in between.
+    void (*start_search)(void);
+    unsigned char (*poll_search)(void);
+
+    // the result of the finished search, which the engine also plays on its
+    // own board
+    unsigned char (*get_best_move)(struct chess_move *move);
+
+    // principal variation of the last search, at most max moves, or 0 if
+    // the engine keeps none.  The GEOS build calls it with the engine's
+    // overlay unloaded, so it must be resident.
+    unsigned char (*get_pv)(struct chess_move *line, unsigned char max);
+
+    // counters of the last or running search, or 0
+    struct search_stats *stats;
+
+    // what the engine learned in earlier games, or 0.  The UI reads it from
+    // disk at startup and writes it back when a game ends, so it must be
+    // resident and fit one VLIR record.
+    void *learn;
+    unsigned int learn_size;
+};
+
+// beta cutoffs found on the first move, in percent
+unsigned char search_first_cutoff_rate(struct search_stats *stats)
+{
+    if(!stats->cutoffs)
+        return 0;
+
+    return (unsigned char)(stats->first_cutoffs * 100 / stats->cutoffs);
+}
+
+// nodes per second of the last (or running) search
+unsigned long search_nps(struct search_stats *stats)
+{
+    unsigned long ticks = stats->elapsed;
+
+    if(!ticks)
+        ticks = ENGINE_TICKS() - stats->start;
+
+    if(!ticks)
+        return 0;
+
+    return stats->nodes * ENGINE_TICKS_PER_SEC / ticks;
+}
+
+#endif
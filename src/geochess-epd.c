@@ -0,0 +1,334 @@
+//===================================================================================
+//
+//                                  GEOCHESS
+//
+// geoChess is a chess game for GEOS under the Commodore 64 and 128 computers
+//
+// Written by Scott Hutter
+// Nov 2023
+//
+// You are free to modify this code as desired, as long as original author credit
+// is mentioned for both the geos code and the included AI engines
+//===================================================================================
+
+//*********************************************************************************
+//
+// EPD test-suite runner.  Every position with a "bm" (best move) or "am"
+// (avoid move) operation is searched at a fixed node, time or depth limit,
+// spread over worker threads.  A position counts as solved when the final
+// move is a best move and not an avoid move; the nodes and time at which the
+// search first settled on that answer are the time-to-solution.
+//
+// geochess-epd [-n nodes] [-t ms] [-d depth] [-j workers] [-T threads] [-H mb] file.epd
+//
+// -T searches each position with that many Lazy SMP threads and -H gives
+// each worker a hash table of that size; the defaults, one thread and no
+// table, search as the GEOS engine does.
+//
+//********************************************************************************
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "geochess-host.h"
+
+#define MAXPOSITIONS    8192
+#define MAXEPDMOVES     8
+
+struct epd_position {
+    char fen[128];
+    char id[64];
+    char bm[MAXEPDMOVES][16];
+    char am[MAXEPDMOVES][16];
+    int bm_count, am_count;
+
+    // results
+    int solved;
+    char played[16];
+    unsigned long nodes, ms;                    // whole search
+    unsigned long solve_nodes, solve_ms;        // when the answer was found for good
+    int solve_depth;
+};
+
+struct epd_position *positions;
+int position_count = 0;
+struct search_limits limits;
+int search_threads = 1;
+unsigned long hash_mb = 0;
+
+pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+int next_position = 0;
+
+// copy the moves of one operation, e.g. "Qxh7+ Rf8" of "bm Qxh7+ Rf8"
+int parse_moves(char *text, char moves[][16])
+{
+    char *token;
+    int n = 0;
+
+    for(token = strtok(text, " \t"); token && n < MAXEPDMOVES; token = strtok(0, " \t"))
+    {
+        strncpy(moves[n], token, 15);
+        moves[n++][15] = 0;
+    }
+
+    return n;
+}
+
+// split an EPD line into the four FEN fields and its operations
+int parse_epd(char *line, struct epd_position *pos)
+{
+    char *p = line;
+    char *op, *next;
+    int fields = 0;
+
+    memset(pos, 0, sizeof(*pos));
+
+    while(*p && fields < 4)
+    {
+        while(*p == ' ')
+            p++;
+        while(*p && *p != ' ')
+            p++;
+        fields++;
+    }
+
+    if(fields < 4 || p - line >= (int)sizeof(pos->fen))
+        return 1;
+
+    memcpy(pos->fen, line, p - line);
+
+    for(op = p; *op; op = next)
+    {
+        next = strchr(op, ';');
+        if(next)
+            *next++ = 0;
+        else
+            next = op + strlen(op);
+
+        while(*op == ' ')
+            op++;
+
+        if(!strncmp(op, "bm ", 3))
+            pos->bm_count = parse_moves(op + 3, pos->bm);
+        else if(!strncmp(op, "am ", 3))
+            pos->am_count = parse_moves(op + 3, pos->am);
+        else if(!strncmp(op, "id ", 3))
+        {
+            op += 3 + strspn(op + 3, " \"");
+            strncpy(pos->id, op, sizeof(pos->id) - 1);
+            pos->id[strcspn(pos->id, "\"")] = 0;
+        }
+    }
+
+    return !(pos->bm_count || pos->am_count);
+}
+
+int load_epd(const char *filename)
+{
+    FILE *f = fopen(filename, "r");
+    char line[1024];
+
+    if(!f)
+        return 1;
+
+    while(position_count < MAXPOSITIONS && fgets(line, sizeof(line), f))
+    {
+        line[strcspn(line, "\r\n")] = 0;
+        if(!parse_epd(line, &positions[position_count]))
+        {
+            if(!positions[position_count].id[0])
+                sprintf(positions[position_count].id, "#%d", position_count + 1);
+            position_count++;
+        }
+    }
+
+    fclose(f);
+    return 0;
+}
+
+// the move matches the position's bm list and none of its am list
+int is_solution(struct host_engine *h, struct epd_position *pos, struct move move)
+{
+    struct host_move list[MAXMOVES];
+    int n = generate_legal(h, list);
+    int i, m, good;
+
+    good = !pos->bm_count;
+
+    for(i = 0; i < pos->bm_count; i++)
+    {
+        m = find_move(h, pos->bm[i], list, n);
+        if(m >= 0 && list[m].move.src == move.src && list[m].move.dst == move.dst)
+            good = 1;
+    }
+
+    for(i = 0; i < pos->am_count; i++)
+    {
+        m = find_move(h, pos->am[i], list, n);
+        if(m >= 0 && list[m].move.src == move.src && list[m].move.dst == move.dst)
+            good = 0;
+    }
+
+    return good;
+}
+
+// after every completed depth: remember when the answer became right
+void epd_info(struct host_engine *h, int score)
+{
+    struct epd_position *pos = h->user;
+    struct engine *e = &h->engine;
+
+    (void)score;
+
+    if(e->pv_length[0] && is_solution(h, pos, e->pv[0][0]))
+    {
+        if(!pos->solve_depth)
+        {
+            pos->solve_depth = h->current_depth;
+            pos->solve_nodes = e->stats.nodes;
+            pos->solve_ms = ENGINE_TICKS() - e->stats.start;
+        }
+    }
+    else
+        pos->solve_depth = 0;
+}
+
+void run_position(struct host_engine *h, struct epd_position *pos)
+{
+    struct host_move list[MAXMOVES];
+    struct move best;
+    int n, i;
+
+    if(set_fen(h, pos->fen))
+    {
+        strcpy(pos->played, "badfen");
+        return;
+    }
+
+    h->limits = limits;
+    h->info = epd_info;
+    h->user = pos;
+    search_best(h, &best);
+
+    pos->nodes = h->engine.stats.nodes;
+    pos->ms = h->engine.stats.elapsed;
+    strcpy(pos->played, "none");
+
+    if(best.src == NO_MOVE)
+        return;
+
+    pos->solved = is_solution(h, pos, best);
+
+    n = generate_legal(h, list);
+    for(i = 0; i < n; i++)
+        if(list[i].move.src == best.src && list[i].move.dst == best.dst)
+            move_to_san(h, &list[i], list, n, pos->played);
+}
+
+void *run_worker(void *arg)
+{
+    struct host_engine *h = malloc(sizeof(struct host_engine));
+    int index;
+
+    host_init(h);
+    h->threads = search_threads;
+    host_set_hash(h, hash_mb);
+
+    for(;;)
+    {
+        pthread_mutex_lock(&lock);
+        index = next_position++;
+        pthread_mutex_unlock(&lock);
+
+        if(index >= position_count)
+            break;
+
+        host_clear_hash(h);
+        run_position(h, &positions[index]);
+    }
+
+    host_release(h);
+    free(h);
+    return arg;
+}
+
+void usage(void)
+{
+    fprintf(stderr, "usage: geochess-epd [-n nodes] [-t ms] [-d depth] [-j workers] [-T threads] [-H mb] file.epd\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    int workers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int opt, i, solved = 0;
+    unsigned long nodes = 0, ms = 0, solve_nodes = 0, solve_ms = 0;
+    struct epd_position *pos;
+    pthread_t *threads;
+
+    while((opt = getopt(argc, argv, "n:t:d:j:T:H:")) != -1)
+    {
+        switch(opt)
+        {
+            case 'n': limits.nodes = strtoul(optarg, 0, 10); break;
+            case 't': limits.movetime = strtoul(optarg, 0, 10); break;
+            case 'd': limits.depth = atoi(optarg); break;
+            case 'j': workers = atoi(optarg); break;
+            case 'T': search_threads = atoi(optarg); break;
+            case 'H': hash_mb = strtoul(optarg, 0, 10); break;
+            default: usage();
+        }
+    }
+
+    if(optind >= argc)
+        usage();
+
+    // without a limit every position gets a second
+    if(!limits.nodes && !limits.movetime && !limits.depth)
+        limits.movetime = 1000;
+
+    positions = calloc(MAXPOSITIONS, sizeof(struct epd_position));
+    if(load_epd(argv[optind]) || !position_count)
+    {
+        fprintf(stderr, "geochess-epd: no positions with bm/am in '%s'\n", argv[optind]);
+        return 1;
+    }
+
+    if(workers < 1)
+        workers = 1;
+    if(workers > position_count)
+        workers = position_count;
+
+    threads = malloc(workers * sizeof(pthread_t));
+    for(i = 0; i < workers; i++)
+        pthread_create(&threads[i], 0, run_worker, 0);
+    for(i = 0; i < workers; i++)
+        pthread_join(threads[i], 0);
+    free(threads);
+
+    for(i = 0; i < position_count; i++)
+    {
+        pos = &positions[i];
+        nodes += pos->nodes;
+        ms += pos->ms;
+
+        printf("%-16s %-7s %-8s %-8s", pos->id, pos->solved ? "solved" : "failed",
+            pos->played, pos->bm_count ? pos->bm[0] : pos->am[0]);
+
+        if(pos->solved)
+        {
+            solved++;
+            solve_nodes += pos->solve_nodes;
+            solve_ms += pos->solve_ms;
+            printf("  depth %2d  %10lu nodes  %7lu ms", pos->solve_depth, pos->solve_nodes, pos->solve_ms);
+        }
+        printf("\n");
+    }
+
+    printf("\nsolved %d of %d  (%lu nodes, %lu ms searched)\n", solved, position_count, nodes, ms);
+    if(solved)
+        printf("average to solution: %lu nodes, %lu ms\n", solve_nodes / solved, solve_ms / solved);
+
+    free(positions);
+    return 0;
+}
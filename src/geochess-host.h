@@ -0,0 +1,767 @@
+//===================================================================================
+//
+//                                  GEOCHESS
+//
+// geoChess is a chess game for GEOS under the Commodore 64 and 128 computers
+//
+// Written by Scott Hutter
+// Nov 2023
+//
+// You are free to modify this code as desired, as long as original author credit
+// is mentioned for both the geos code and the included AI engines
+//===================================================================================
+
+#ifndef GEOCHESS_HOST_H
+#define GEOCHESS_HOST_H
+
+//*********************************************************************************
+//
+// Host (Linux / POSIX) glue around the engine in geochess-ai.h.  The host tools
+// include this instead of the engine header: it supplies a millisecond clock,
+// deeper search limits, FEN setup, long algebraic move text and an iterative
+// deepening driver.  The engine is built reentrant, so every function here
+// works on its own struct host_engine and tools may run one per thread.
+//
+// With a hash table (host_set_hash()) the search also orders moves, and
+// with more than one thread it becomes a Lazy SMP search: helper threads
+// search the same root, staggered by a ply, and share their results only
+// through the table.  The answer is the main thread's, so one thread gives
+// the same result on every run, and no table gives plain BMCP.
+//
+// Moves are generated from bitboards (geochess-ai-bitboard.h); build with
+// -DHOST_0X88 to use the GEOS build's 0x88 generator instead.
+//
+//********************************************************************************
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+unsigned long host_ticks(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long)ts.tv_sec * 1000UL + (unsigned long)(ts.tv_nsec / 1000000L);
+}
+
+#define ENGINE_TICKS()          host_ticks()
+#define ENGINE_TICKS_PER_SEC    1000UL
+
+#ifndef MAX_PLY
+#define MAX_PLY         64
+#endif
+
+#ifndef PROGRESS_MASK
+#define PROGRESS_MASK   1023
+#endif
+
+#ifndef MOVE_STACK
+#define MOVE_STACK      (MAX_PLY * 128)
+#endif
+
+#ifndef PAWN_ENTRIES
+#define PAWN_ENTRIES    4096
+#endif
+
+#ifndef MULTIPV_MAX
+#define MULTIPV_MAX     16
+#endif
+
+#ifndef REP_RING
+#define REP_RING        256
+#endif
+
+#define ENGINE_REENTRANT
+#define ENGINE_HASH
+
+// bitboard move generation unless built with -DHOST_0X88
+#ifndef HOST_0X88
+#define ENGINE_BITBOARDS
+#endif
+
+#define MAX_THREADS     64
+
+#include "geochess-ai.h"
+
+#define STARTPOS    "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1"
+
+struct search_limits {
+    int depth;                  // 0 = no limit
+    unsigned long nodes;        // 0 = no limit
+    unsigned long movetime;     // ms, 0 = no limit
+    unsigned long wtime, btime, winc, binc;
+    int movestogo;
+    int infinite;
+};
+
+struct host_engine {
+    struct engine engine;       // first, so the progress hook can find its host_engine
+
+    struct search_limits limits;
+    unsigned long deadline;     // tick at which the search must stop, 0 = none
+    int current_depth;
+    volatile int stop_requested;
+
+    void (*poll)(struct host_engine *h);            // extra work while searching, e.g. reading stdin
+    void (*info)(struct host_engine *h, int score); // called after each completed iteration
+    void *user;
+
+    int threads;                // search threads, 1 = the main one only
+    struct tt_entry *tt;        // shared by all threads, 0 = none
+    unsigned long tt_entries;
+    volatile int helpers_stop;  // set when the main thread is done
+};
+
+// a helper thread of the Lazy SMP search
+struct smp_helper {
+    struct engine engine;       // first, so the progress hook can find its smp_helper
+    struct host_engine *owner;
+    int index;
+    pthread_t thread;
+};
+
+int piece_from_char(char c)
+{
+    switch(c)
+    {
+        case 'P': return 9;     case 'p': return 18;
+        case 'N': return 12;    case 'n': return 20;
+        case 'B': return 13;    case 'b': return 21;
+        case 'R': return 14;    case 'r': return 22;
+        case 'Q': return 15;    case 'q': return 23;
+        case 'K': return 11;    case 'k': return 19;
+    }
+
+    return 0;
+}
+
+char piece_to_char(int piece)
+{
+    static const char types[] = "?PPKNBRQ";
+    char c = types[piece & 7];
+
+    return (piece & 16) ? c + ('a' - 'A') : c;
+}
+
+// square from text such as "e4", -1 if not a board square
+int square_from_text(const char *text)
+{
+    if(text[0] < 'a' || text[0] > 'h' || text[1] < '1' || text[1] > '8')
+        return -1;
+
+    return ('8' - text[1]) * 16 + (text[0] - 'a');
+}
+
+pthread_once_t tables_once = PTHREAD_ONCE_INIT;
+
+// tables shared by every engine, built before the first one starts
+void host_tables_init(void)
+{
+    hash_init();
+    pawn_init();
+#ifdef ENGINE_BITBOARDS
+    bb_init();
+#endif
+}
+
+void host_init(struct host_engine *h)
+{
+    pthread_once(&tables_once, host_tables_init);
+
+    memset(h, 0, sizeof(*h));
+    engine_init(&h->engine);
+    h->threads = 1;
+}
+
+// (re)allocate the hash table, the largest power of two of entries that
+// fits in mb megabytes; 0 removes it.  Returns 0 on success.
+int host_set_hash(struct host_engine *h, unsigned long mb)
+{
+    unsigned long entries = 1;
+
+    free(h->tt);
+    h->tt = 0;
+    h->tt_entries = 0;
+
+    if(!mb)
+        return 0;
+
+    while(entries * 2 * sizeof(struct tt_entry) <= mb * 1024 * 1024)
+        entries *= 2;
+
+    if(!(h->tt = calloc(entries, sizeof(struct tt_entry))))
+        return 1;
+
+    h->tt_entries = entries;
+    return 0;
+}
+
+void host_clear_hash(struct host_engine *h)
+{
+    if(h->tt)
+        memset(h->tt, 0, h->tt_entries * sizeof(struct tt_entry));
+}
+
+void host_release(struct host_engine *h)
+{
+    host_set_hash(h, 0);
+}
+
+// set up the engine from a FEN string, returns 0 on success
+int set_fen(struct host_engine *h, const char *fen)
+{
+    struct engine *e = &h->engine;
+    int sq = 0;
+    int piece, beside;
+
+    engine_init(e);
+
+    // the right half of each 0x88 row holds positional scores, keep those
+    for(sq = 0; sq < 128; sq++)
+        if(!(sq & 0x88))
+            e->board[sq] = 0;
+
+    sq = 0;
+    while(*fen && *fen != ' ')
+    {
+        if(*fen == '/')
+            sq = (sq & 0x70) + 16;
+        else if(*fen >= '1' && *fen <= '8')
+            sq += *fen - '0';
+        else
+        {
+            if(!(piece = piece_from_char(*fen)) || (sq & 0x88))
+                return 1;
+            e->board[sq++] = piece;
+        }
+        fen++;
+    }
+
+    while(*fen == ' ')
+        fen++;
+    e->side = (*fen == 'b') ? 16 : 8;
+    if(*fen)
+        fen++;
+
+    while(*fen == ' ')
+        fen++;
+    e->castle = 0;
+    while(*fen && *fen != ' ')
+    {
+        switch(*fen++)
+        {
+            case 'K': e->castle |= CASTLE_WK; break;
+            case 'Q': e->castle |= CASTLE_WQ; break;
+            case 'k': e->castle |= CASTLE_BK; break;
+            case 'q': e->castle |= CASTLE_BQ; break;
+        }
+    }
+    e->castle &= castle_allowed(e);
+
+    // like make_move(), keep the square only when a pawn can take there
+    while(*fen == ' ')
+        fen++;
+    e->ep = NO_EP;
+    if((sq = square_from_text(fen)) >= 0)
+    {
+        // the pawn that moved two squares stands one row past sq
+        piece = (e->side == 8) ? 9 : 18;
+        beside = sq + ((e->side == 8) ? 16 : -16);
+        if((!((beside + 1) & 0x88) && e->board[beside + 1] == piece)
+            || (!((beside - 1) & 0x88) && e->board[beside - 1] == piece))
+            e->ep = sq;
+    }
+
+    // the half-move clock, when given
+    while(*fen && *fen != ' ')
+        fen++;
+    e->fifty = (unsigned int)atoi(fen);
+
+    // the moves played from here are keyed from the exact position
+    e->hash = hash_position(e, e->side);
+
+    return 0;
+}
+
+// the first four FEN fields of the current position, as EPD uses them
+void get_epd(struct host_engine *h, char *out)
+{
+    struct engine *e = &h->engine;
+    int r, c, empty;
+
+    for(r = 0; r < 8; r++)
+    {
+        empty = 0;
+        for(c = 0; c < 8; c++)
+        {
+            if(!e->board[r * 16 + c])
+                empty++;
+            else
+            {
+                if(empty)
+                    *out++ = '0' + empty;
+                empty = 0;
+                *out++ = piece_to_char(e->board[r * 16 + c]);
+            }
+        }
+        if(empty)
+            *out++ = '0' + empty;
+        *out++ = (r < 7) ? '/' : ' ';
+    }
+
+    *out++ = (e->side == 8) ? 'w' : 'b';
+    *out++ = ' ';
+
+    if(!e->castle)
+        *out++ = '-';
+    if(e->castle & CASTLE_WK) *out++ = 'K';
+    if(e->castle & CASTLE_WQ) *out++ = 'Q';
+    if(e->castle & CASTLE_BK) *out++ = 'k';
+    if(e->castle & CASTLE_BQ) *out++ = 'q';
+    *out++ = ' ';
+
+    strcpy(out, e->ep != NO_EP ? notation[e->ep] : "-");
+}
+
+// long algebraic text for a move on the current board ("e7e8q" on promotion)
+void move_to_text(struct host_engine *h, struct move move, char *out)
+{
+    static const char promo[] = "????nbrq";
+    int src = MOVE_SQUARE(move.src), dst = MOVE_SQUARE(move.dst);
+
+    strcpy(out, notation[src]);
+    strcat(out, notation[dst]);
+
+    if(MOVE_FLAG(move) == MOVE_PROMOTE)
+    {
+        out[4] = promo[PROMOTION_TYPE(move)];
+        out[5] = 0;
+    }
+    else if((h->engine.board[src] & 7) < 3 && (dst < 8 || dst >= 112))
+        strcat(out, "q");
+}
+
+// the engine's move for long algebraic text, with the flags it needs;
+// returns 0 on success
+int text_to_move(struct host_engine *h, const char *text, struct move *move)
+{
+    struct engine *e = &h->engine;
+    int src = square_from_text(text);
+    int dst = square_from_text(text + 2);
+    int piece, promo;
+
+    if(src < 0 || dst < 0 || !(piece = e->board[src]))
+        return 1;
+
+    move->src = src;
+    move->dst = dst;
+
+    if((piece & 7) == 3 && (dst - src == 2 || src - dst == 2))
+        move->src |= MOVE_CASTLE;
+    else if((piece & 7) < 3 && dst == e->ep && !e->board[dst])
+        move->src |= MOVE_EP;
+    else if((piece & 7) < 3 && (dst < 8 || dst >= 112) && text[4]
+        && (promo = piece_from_char(text[4]) & 7) >= 4 && promo < 7)
+    {
+        move->src |= MOVE_PROMOTE;
+        move->dst |= PROMOTION_BITS(promo);
+    }
+
+    return 0;
+}
+
+// play a move given as long algebraic text, returns 0 on success
+int make_text_move(struct host_engine *h, const char *text)
+{
+    struct move move;
+
+    if(text_to_move(h, text, &move))
+        return 1;
+
+    play_move(&h->engine, move);
+    return 0;
+}
+
+// text of a line from the current position, such as e->pv[0] or the
+// line of one of e->root_moves
+void pv_to_text(struct host_engine *h, const struct move *line, unsigned char length, char *out)
+{
+    struct engine *e = &h->engine;
+    char move[6];
+    unsigned char i;
+
+    out[0] = 0;
+
+    for(i = 0; i < length; i++)
+    {
+        move_to_text(h, line[i], move);
+        if(i)
+            strcat(out, " ");
+        strcat(out, move);
+        make_move(e, line[i]);
+    }
+
+    while(i--)
+        unmake_move(e, line[i]);
+}
+
+// Legal moves of the side to move: the engine's own, less those that leave
+// the king to be taken.  The host tools use these to read and write
+// standard move notation.
+#define MAXMOVES    256
+
+struct host_move {
+    int src, dst;
+    int promo;                  // promotion piece type (4..7), 0 if none
+    struct move move;           // as the engine plays it
+};
+
+void host_move_to_text(const struct host_move *m, char *out)
+{
+    static const char promo[] = "????nbrq";
+
+    strcpy(out, notation[m->src]);
+    strcat(out, notation[m->dst]);
+    if(m->promo)
+    {
+        out[4] = promo[m->promo];
+        out[5] = 0;
+    }
+}
+
+int generate_legal(struct host_engine *h, struct host_move *list)
+{
+    struct engine *e = &h->engine;
+    struct move *moves = &e->move_stack[e->move_sp];
+    int side = e->side;
+    int n, i, count = 0;
+
+    n = GenerateMoves(e, side, moves);
+    if(n == KING_CAPTURE)
+        return 0;
+    n = generate_special(e, side, moves, n);
+    e->move_sp += n;
+
+    for(i = 0; i < n; i++)
+    {
+        make_move(e, moves[i]);
+
+        if(GenerateMoves(e, 24 - side, &e->move_stack[e->move_sp]) != KING_CAPTURE)
+        {
+            list[count].src = MOVE_SQUARE(moves[i].src);
+            list[count].dst = MOVE_SQUARE(moves[i].dst);
+            list[count].promo = 0;
+            if(MOVE_FLAG(moves[i]) == MOVE_PROMOTE)
+                list[count].promo = PROMOTION_TYPE(moves[i]);
+            else if((e->undo_stack[e->undo_sp - 1].piece & 7) < 3 && (list[count].dst < 8 || list[count].dst >= 112))
+                list[count].promo = 7;
+            list[count++].move = moves[i];
+        }
+
+        unmake_move(e, moves[i]);
+    }
+
+    e->move_sp -= n;
+    return count;
+}
+
+// "+" after a legal move that gives check, "#" after one that mates
+void append_check_mark(struct host_engine *h, const struct host_move *m, char *out)
+{
+    struct engine *e = &h->engine;
+    struct host_move replies[MAXMOVES];
+
+    make_move(e, m->move);
+    e->side = 24 - e->side;
+    if(king_attacked(e, e->side))
+        strcat(out, generate_legal(h, replies) ? "+" : "#");
+    e->side = 24 - e->side;
+    unmake_move(e, m->move);
+}
+
+// standard algebraic notation of a legal move
+void move_to_san(struct host_engine *h, const struct host_move *m, const struct host_move *list, int n, char *out)
+{
+    static const char letters[] = "??PKNBRQ";
+    struct engine *e = &h->engine;
+    int piece = e->board[m->src];
+    int type = piece & 7;
+    int capture = e->board[m->dst] || MOVE_FLAG(m->move) == MOVE_EP;
+    int i, ambiguous = 0, same_file = 0, same_rank = 0;
+    char *p = out;
+
+    if(type == 3 && (m->dst - m->src == 2 || m->src - m->dst == 2))
+    {
+        strcpy(out, m->dst > m->src ? "O-O" : "O-O-O");
+        append_check_mark(h, m, out);
+        return;
+    }
+
+    if(type < 3)
+    {
+        if(capture)
+        {
+            *p++ = 'a' + (m->src & 7);
+            *p++ = 'x';
+        }
+    }
+    else
+    {
+        *p++ = letters[type];
+
+        for(i = 0; i < n; i++)
+        {
+            if(list[i].dst != m->dst || list[i].src == m->src || e->board[list[i].src] != piece)
+                continue;
+            ambiguous = 1;
+            if((list[i].src & 7) == (m->src & 7))
+                same_file = 1;
+            if((list[i].src >> 4) == (m->src >> 4))
+                same_rank = 1;
+        }
+
+        if(ambiguous)
+        {
+            if(!same_file)
+                *p++ = 'a' + (m->src & 7);
+            else if(!same_rank)
+                *p++ = '8' - (m->src >> 4);
+            else
+            {
+                *p++ = 'a' + (m->src & 7);
+                *p++ = '8' - (m->src >> 4);
+            }
+        }
+
+        if(capture)
+            *p++ = 'x';
+    }
+
+    *p++ = notation[m->dst][0];
+    *p++ = notation[m->dst][1];
+
+    if(m->promo)
+    {
+        *p++ = '=';
+        *p++ = letters[m->promo];
+    }
+    *p = 0;
+
+    append_check_mark(h, m, out);
+}
+
+// find the legal move written as SAN or long algebraic text, -1 if none
+int find_move(struct host_engine *h, const char *text, const struct host_move *list, int n)
+{
+    char wanted[16], san[16], lan[6];
+    int i, len;
+
+    // check marks and annotations are not part of the move
+    strncpy(wanted, text, sizeof(wanted) - 1);
+    wanted[sizeof(wanted) - 1] = 0;
+    len = strcspn(wanted, "+#!?");
+    wanted[len] = 0;
+
+    for(i = 0; i < n; i++)
+    {
+        move_to_san(h, &list[i], list, n, san);
+        san[strcspn(san, "+#")] = 0;
+        host_move_to_text(&list[i], lan);
+        if(!strcmp(wanted, san) || !strcmp(wanted, lan))
+            return i;
+
+        // castling is sometimes written with zeros
+        if(san[0] == 'O' && ((!strcmp(wanted, "0-0") && !strcmp(san, "O-O"))
+            || (!strcmp(wanted, "0-0-0") && !strcmp(san, "O-O-O"))))
+            return i;
+    }
+
+    return -1;
+}
+
+// installed as search_progress while search_best() runs
+void host_progress(struct engine *e)
+{
+    struct host_engine *h = (struct host_engine *)e;
+
+    if(h->poll)
+        h->poll(h);
+
+    if(h->limits.nodes && e->stats.nodes >= h->limits.nodes)
+        h->stop_requested = 1;
+
+    if(h->deadline && ENGINE_TICKS() >= h->deadline)
+        h->stop_requested = 1;
+
+    // depth 2 is the shallowest search that sees its own king hang,
+    // so it always completes
+    if(h->stop_requested && h->current_depth > 2)
+        e->search_stop = 1;
+}
+
+// installed as search_progress of the helpers
+void helper_progress(struct engine *e)
+{
+    struct smp_helper *helper = (struct smp_helper *)e;
+
+    if(helper->owner->helpers_stop)
+        e->search_stop = 1;
+}
+
+// Helpers deepen from the same root as the main thread until it is done.
+// Odd helpers run a ply ahead, so the threads do not all search the same
+// depth at the same time.
+void *helper_search(void *arg)
+{
+    struct smp_helper *helper = arg;
+    struct engine *e = &helper->engine;
+    int depth;
+
+    for(depth = 2 + (helper->index & 1); depth < MAX_PLY && !helper->owner->helpers_stop; depth++)
+    {
+        e->ply = 0;
+        e->move_sp = 0;
+        SearchPosition(e, e->side, depth, -KING_TAKEN, KING_TAKEN);
+    }
+
+    return 0;
+}
+
+// Iterative deepening search of the current position within h->limits.
+// Returns the score of the last completed depth and stores its best move,
+// with NO_MOVE as src if the side to move has no legal move.
+int search_best(struct host_engine *h, struct move *best)
+{
+    struct engine *e = &h->engine;
+    struct search_limits *limits = &h->limits;
+    int score = 0;
+    int result = 0;
+    int completed = 0;
+    int max_depth = MAX_PLY - 1;
+    unsigned long budget = 0;
+    unsigned long mytime = (e->side == 8) ? limits->wtime : limits->btime;
+    unsigned long myinc = (e->side == 8) ? limits->winc : limits->binc;
+    struct smp_helper *helpers[MAX_THREADS];
+    int threads, i;
+
+    best->src = best->dst = NO_MOVE;
+
+    if(limits->depth && limits->depth < max_depth)
+        max_depth = limits->depth < 2 ? 2 : limits->depth;
+
+    // share the clock over the remaining moves, keeping a safety margin
+    if(limits->movetime)
+        budget = limits->movetime;
+    else if(mytime && !limits->infinite)
+    {
+        budget = mytime / (limits->movestogo ? limits->movestogo + 1 : 30) + myinc / 2;
+        if(budget > mytime / 2)
+            budget = mytime / 2;
+    }
+
+    engine_stats_reset(e, 0);
+    h->deadline = budget ? e->stats.start + budget : 0;
+    h->stop_requested = 0;
+    e->search_stop = 0;
+    e->search_progress = host_progress;
+
+    e->tt = h->tt;
+    e->tt_mask = h->tt_entries - 1;
+    memset(e->killers, 0, sizeof(e->killers));
+    memset(e->history, 0, sizeof(e->history));
+
+    // helpers copy the position and start with empty killers and history;
+    // the search goes on with those that could be started
+    threads = (h->tt && h->threads > 1) ? (h->threads > MAX_THREADS ? MAX_THREADS : h->threads) : 1;
+    h->helpers_stop = 0;
+    for(i = 1; i < threads; i++)
+    {
+        if(!(helpers[i] = malloc(sizeof(struct smp_helper))))
+        {
+            threads = i;
+            break;
+        }
+        memcpy(&helpers[i]->engine, e, sizeof(struct engine));
+        helpers[i]->engine.search_progress = helper_progress;
+        helpers[i]->engine.multipv = 0;
+        helpers[i]->owner = h;
+        helpers[i]->index = i;
+        if(pthread_create(&helpers[i]->thread, 0, helper_search, helpers[i]))
+        {
+            free(helpers[i]);
+            threads = i;
+            break;
+        }
+    }
+
+    for(h->current_depth = 2; h->current_depth <= max_depth; h->current_depth++)
+    {
+        e->stats.depth = h->current_depth;
+        score = SearchPosition(e, e->side, h->current_depth, -KING_TAKEN, KING_TAKEN);
+
+        if(e->search_stop)
+            break;
+
+        result = score;
+        completed = h->current_depth;
+        best->src = best->dst = NO_MOVE;
+        if(e->pv_length[0])
+            *best = e->pv[0][0];
+
+        if(h->info)
+            h->info(h, score);
+
+        // a found mate will not change, and the next iteration
+        // would probably not finish in time
+        if(score > MATE_BOUND || score < -MATE_BOUND)
+            break;
+        if(budget && ENGINE_TICKS() - e->stats.start > budget / 2)
+            break;
+        if(h->stop_requested)
+            break;
+    }
+
+    // the helpers' nodes count towards the search
+    h->helpers_stop = 1;
+    for(i = 1; i < threads; i++)
+    {
+        pthread_join(helpers[i]->thread, 0);
+        e->stats.nodes += helpers[i]->engine.stats.nodes;
+        e->stats.hash_hits += helpers[i]->engine.stats.hash_hits;
+        free(helpers[i]);
+    }
+
+    // the depth the returned move comes from, not one left unfinished
+    e->stats.depth = completed;
+    engine_stats_finish(e);
+    e->search_progress = 0;
+    e->search_stop = 0;
+
+    return result;
+}
+
+// the side to move is attacked, i.e. the other side could capture its king
+int in_check(struct host_engine *h)
+{
+    return king_attacked(&h->engine, h->engine.side);
+}
+
+void print_board(struct host_engine *h, FILE *f)
+{
+    struct engine *e = &h->engine;
+    int r, c;
+
+    for(r = 0; r < 8; r++)
+    {
+        fprintf(f, "%d ", 8 - r);
+        for(c = 0; c < 8; c++)
+            fprintf(f, " %c", e->board[r * 16 + c] ? piece_to_char(e->board[r * 16 + c]) : '.');
+        fprintf(f, "\n");
+    }
+    fprintf(f, "\n   a b c d e f g h    %s to move\n", e->side == 8 ? "white" : "black");
+}
+
+#endif
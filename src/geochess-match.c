@@ -0,0 +1,434 @@
+//===================================================================================
+//
+//                                  GEOCHESS
+//
+// geoChess is a chess game for GEOS under the Commodore 64 and 128 computers
+//
+// Written by Scott Hutter
+// Nov 2023
+//
+// You are free to modify this code as desired, as long as original author credit
+// is mentioned for both the geos code and the included AI engines
+//===================================================================================
+
+//*********************************************************************************
+//
+// Self-play match runner.  Two engine configurations (search limits and piece
+// values) play each opening from a file with both colours, one game per worker
+// thread across all cores.  Each worker owns its engine context.
+//
+// geochess-match [-a spec] [-b spec] [-o openings] [-g games] [-j workers] [-p plies]
+//
+// spec is a comma separated list such as "depth=4" or "nodes=20000,knight=320"
+// with the keys name, depth, nodes, movetime, pawn, knight, bishop, rook, queen.
+//
+//********************************************************************************
+
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "geochess-host.h"
+
+#define MAXOPENINGS     4096
+#define MAXGAMEPLIES    1024
+
+struct engine_config {
+    char name[32];
+    struct search_limits limits;
+    int weights[16];            // replaces piece_weights[] while this side searches
+};
+
+struct game_result {
+    int game;
+    int result;                 // from A's point of view: 2 win, 1 draw, 0 loss
+    int plies;
+    char reason[16];
+    unsigned long moves[2];     // engine moves played by A and B
+    unsigned long nodes[2];
+    unsigned long us[2];        // microseconds spent searching
+};
+
+struct engine_config config[2];
+char *openings[MAXOPENINGS];
+int opening_count = 0;
+int max_plies = 400;
+int games = 0;
+
+// shared between the workers, guarded by lock
+pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+int next_game = 0;
+int wins = 0, draws = 0, losses = 0, done = 0;
+unsigned long total_moves[2], total_nodes[2], total_us[2];
+
+unsigned long usec_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long)ts.tv_sec * 1000000UL + (unsigned long)(ts.tv_nsec / 1000L);
+}
+
+int parse_config(struct engine_config *cfg, const char *spec)
+{
+    char buffer[256];
+    char *token, *value;
+    int weight;
+
+    memcpy(cfg->weights, default_piece_weights, sizeof(cfg->weights));
+    memset(&cfg->limits, 0, sizeof(cfg->limits));
+    cfg->limits.depth = 2;
+    strncpy(cfg->name, spec, sizeof(cfg->name) - 1);
+
+    strncpy(buffer, spec, sizeof(buffer) - 1);
+    buffer[sizeof(buffer) - 1] = 0;
+
+    for(token = strtok(buffer, ","); token; token = strtok(0, ","))
+    {
+        if(!(value = strchr(token, '=')))
+            return 1;
+        *value++ = 0;
+        weight = atoi(value);
+
+        if(!strcmp(token, "name"))
+            strncpy(cfg->name, value, sizeof(cfg->name) - 1);
+        else if(!strcmp(token, "depth"))
+            cfg->limits.depth = weight;
+        else if(!strcmp(token, "nodes"))
+        {
+            cfg->limits.nodes = strtoul(value, 0, 10);
+            cfg->limits.depth = 0;
+        }
+        else if(!strcmp(token, "movetime"))
+        {
+            cfg->limits.movetime = strtoul(value, 0, 10);
+            cfg->limits.depth = 0;
+        }
+        else if(!strcmp(token, "pawn"))
+        {
+            cfg->weights[9] = weight;
+            cfg->weights[2] = -weight;
+        }
+        else if(!strcmp(token, "knight"))
+        {
+            cfg->weights[12] = weight;
+            cfg->weights[4] = -weight;
+        }
+        else if(!strcmp(token, "bishop"))
+        {
+            cfg->weights[13] = weight;
+            cfg->weights[5] = -weight;
+        }
+        else if(!strcmp(token, "rook"))
+        {
+            cfg->weights[14] = weight;
+            cfg->weights[6] = -weight;
+        }
+        else if(!strcmp(token, "queen"))
+        {
+            cfg->weights[15] = weight;
+            cfg->weights[7] = -weight;
+        }
+        else
+            return 1;
+    }
+
+    return 0;
+}
+
+int load_openings(const char *filename)
+{
+    FILE *f = fopen(filename, "r");
+    char line[256];
+
+    if(!f)
+        return 1;
+
+    while(opening_count < MAXOPENINGS && fgets(line, sizeof(line), f))
+    {
+        line[strcspn(line, "\r\n")] = 0;
+        if(line[0] && line[0] != '#')
+            openings[opening_count++] = strdup(line);
+    }
+
+    fclose(f);
+    return 0;
+}
+
+// neither side can mate: kings with at most one minor piece between them
+int insufficient_material(struct engine *e)
+{
+    int sq, minors = 0;
+
+    for(sq = 0; sq < 128; sq++)
+    {
+        if((sq & 0x88) || !e->board[sq])
+            continue;
+
+        switch(e->board[sq] & 7)
+        {
+            case 3:
+                break;
+            case 4:
+            case 5:
+                minors++;
+                break;
+            default:
+                return 0;
+        }
+    }
+
+    return minors <= 1;
+}
+
+// position key for repetition checks: the 64 squares plus the side to move
+void position_key(struct engine *e, char *key)
+{
+    int sq, i = 0;
+
+    for(sq = 0; sq < 128; sq++)
+        if(!(sq & 0x88))
+            key[i++] = (char)e->board[sq];
+    key[64] = (char)e->side;
+}
+
+void play_game(struct host_engine *h, char history[][65], int game, struct game_result *res)
+{
+    struct engine *e = &h->engine;
+    struct engine_config *cfg;
+    int a_is_white = !(game & 1);
+    int halfmove = 0;
+    struct move best;
+    int capture, pawn, i, repeats, engine;
+    unsigned long start;
+
+    memset(res, 0, sizeof(*res));
+    res->game = game;
+    res->result = -1;
+
+    set_fen(h, openings[(game / 2) % opening_count]);
+    position_key(e, history[0]);
+
+    for(res->plies = 0; res->plies < max_plies && res->plies < MAXGAMEPLIES; )
+    {
+        // config[0] is A, config[1] is B
+        engine = ((e->side == 8) == a_is_white) ? 0 : 1;
+        cfg = &config[engine];
+
+        memcpy(e->piece_weights, cfg->weights, sizeof(cfg->weights));
+        h->limits = cfg->limits;
+        start = usec_now();
+        search_best(h, &best);
+
+        res->moves[engine]++;
+        res->nodes[engine] += e->stats.nodes;
+        res->us[engine] += usec_now() - start;
+
+        if(best.src == NO_MOVE)
+        {
+            if(in_check(h))
+            {
+                res->result = engine ? 2 : 0;
+                strcpy(res->reason, "mate");
+            }
+            else
+            {
+                res->result = 1;
+                strcpy(res->reason, "stalemate");
+            }
+            return;
+        }
+
+        capture = e->board[MOVE_SQUARE(best.dst)] || MOVE_FLAG(best) == MOVE_EP;
+        pawn = (e->board[MOVE_SQUARE(best.src)] & 7) < 3;
+        play_move(e, best);
+        res->plies++;
+
+        halfmove = (capture || pawn) ? 0 : halfmove + 1;
+        position_key(e, history[res->plies]);
+
+        if(halfmove >= 100)
+        {
+            res->result = 1;
+            strcpy(res->reason, "fifty moves");
+            return;
+        }
+
+        // only positions since the last capture or pawn move can repeat
+        repeats = 0;
+        for(i = res->plies - 2; i >= 0 && i >= res->plies - halfmove; i -= 2)
+            if(!memcmp(history[i], history[res->plies], 65))
+                repeats++;
+
+        if(repeats >= 2)
+        {
+            res->result = 1;
+            strcpy(res->reason, "repetition");
+            return;
+        }
+
+        if(insufficient_material(e))
+        {
+            res->result = 1;
+            strcpy(res->reason, "material");
+            return;
+        }
+    }
+
+    res->result = 1;
+    strcpy(res->reason, "max plies");
+}
+
+void report(struct game_result *res)
+{
+    int i;
+
+    pthread_mutex_lock(&lock);
+
+    if(res->result == 2)
+        wins++;
+    else if(res->result == 1)
+        draws++;
+    else
+        losses++;
+
+    for(i = 0; i < 2; i++)
+    {
+        total_moves[i] += res->moves[i];
+        total_nodes[i] += res->nodes[i];
+        total_us[i] += res->us[i];
+    }
+
+    done++;
+    printf("game %4d  %s  %3d plies  %-11s  +%d =%d -%d\n", res->game + 1,
+        res->result == 2 ? "1-0" : (res->result == 1 ? "1/2" : "0-1"),
+        res->plies, res->reason, wins, draws, losses);
+    fflush(stdout);
+
+    pthread_mutex_unlock(&lock);
+}
+
+void *run_worker(void *arg)
+{
+    struct host_engine *h = malloc(sizeof(struct host_engine));
+    char (*history)[65] = malloc((MAXGAMEPLIES + 1) * 65);
+    struct game_result res;
+    int game;
+
+    host_init(h);
+
+    for(;;)
+    {
+        pthread_mutex_lock(&lock);
+        game = next_game++;
+        pthread_mutex_unlock(&lock);
+
+        if(game >= games)
+            break;
+
+        play_game(h, history, game, &res);
+        report(&res);
+    }
+
+    free(history);
+    free(h);
+    return arg;
+}
+
+// Elo difference for a score fraction
+double elo(double score)
+{
+    if(score <= 0.0)
+        return -999.0;
+    if(score >= 1.0)
+        return 999.0;
+
+    return -400.0 * log10(1.0 / score - 1.0);
+}
+
+void usage(void)
+{
+    fprintf(stderr, "usage: geochess-match [-a spec] [-b spec] [-o openings] [-g games] [-j workers] [-p plies]\n");
+    fprintf(stderr, "spec: name=,depth=,nodes=,movetime=,pawn=,knight=,bishop=,rook=,queen= (comma separated)\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *spec_a = "depth=3";
+    const char *spec_b = "depth=2";
+    const char *openings_file = 0;
+    int workers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int opt, i;
+    pthread_t *threads;
+    double n, score, variance, margin;
+
+    while((opt = getopt(argc, argv, "a:b:o:g:j:p:")) != -1)
+    {
+        switch(opt)
+        {
+            case 'a': spec_a = optarg; break;
+            case 'b': spec_b = optarg; break;
+            case 'o': openings_file = optarg; break;
+            case 'g': games = atoi(optarg); break;
+            case 'j': workers = atoi(optarg); break;
+            case 'p': max_plies = atoi(optarg); break;
+            default: usage();
+        }
+    }
+
+    if(parse_config(&config[0], spec_a) || parse_config(&config[1], spec_b))
+        usage();
+
+    if(openings_file)
+    {
+        if(load_openings(openings_file) || !opening_count)
+        {
+            fprintf(stderr, "geochess-match: no openings in '%s'\n", openings_file);
+            return 1;
+        }
+    }
+    else
+        openings[opening_count++] = STARTPOS;
+
+    // every opening is played once with each colour
+    if(games <= 0)
+        games = opening_count * 2;
+    if(workers < 1)
+        workers = 1;
+    if(workers > games)
+        workers = games;
+
+    printf("%s vs %s: %d games on %d workers\n", config[0].name, config[1].name, games, workers);
+    fflush(stdout);
+
+    threads = malloc(workers * sizeof(pthread_t));
+    for(i = 0; i < workers; i++)
+        pthread_create(&threads[i], 0, run_worker, 0);
+    for(i = 0; i < workers; i++)
+        pthread_join(threads[i], 0);
+    free(threads);
+
+    if(!done)
+        return 1;
+
+    // 95% confidence interval from the per-game score variance
+    n = done;
+    score = (wins + draws * 0.5) / n;
+    variance = (wins * (1.0 - score) * (1.0 - score) + draws * (0.5 - score) * (0.5 - score)
+        + losses * score * score) / n;
+    margin = 1.96 * sqrt(variance / n);
+
+    printf("\n%s vs %s: +%d =%d -%d  score %.1f%%  elo %+.1f +/- %.1f\n",
+        config[0].name, config[1].name, wins, draws, losses, score * 100.0, elo(score),
+        (elo(score + margin) - elo(score - margin)) / 2.0);
+
+    for(i = 0; i < 2; i++)
+    {
+        printf("%-20s %10.0f nodes/move  %8.2f ms/move\n", config[i].name,
+            total_moves[i] ? (double)total_nodes[i] / total_moves[i] : 0.0,
+            total_moves[i] ? (double)total_us[i] / total_moves[i] / 1000.0 : 0.0);
+    }
+
+    return 0;
+}
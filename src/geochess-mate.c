@@ -0,0 +1,188 @@
+//===================================================================================
+//
+//                                  GEOCHESS
+//
+// geoChess is a chess game for GEOS under the Commodore 64 and 128 computers
+//
+// Written by Scott Hutter
+// Nov 2023
+//
+// You are free to modify this code as desired, as long as original author credit
+// is mentioned for both the geos code and the included AI engines
+//===================================================================================
+
+//*********************************************************************************
+//
+// Mate solver, the host side of the "solve mate" menu item.  Every position
+// of an EPD or FEN file is searched by the df-pn solver of geochess-mate.h
+// for a mate by the side to move, and the shortest mating line found is
+// written in SAN, or that there is none within the limit.
+//
+// geochess-mate [-m moves] [-c] [-n nodes] [-t ms] [-H mb] file.epd
+//
+//  -m      longest mate looked for, default 3; a "dm" operation overrides it
+//  -c      the attacker only gives check
+//  -n -t   give up on a position after that many nodes or milliseconds
+//  -H      table size, default 64 MB
+//
+// A position with "dm n" counts as solved when its mate in n is found.
+//
+//********************************************************************************
+
+#include <stdlib.h>
+#include <unistd.h>
+#include "geochess-host.h"
+#include "geochess-mate.h"
+
+#define MAXLINE     1024
+
+unsigned long node_limit = 0;
+unsigned long time_limit = 0;
+unsigned long started;
+
+// stop at the time limit
+void mate_progress(struct mate_search *ms)
+{
+    if(time_limit && host_ticks() - started >= time_limit)
+        ms->stop = 1;
+}
+
+// the solver's line as SAN
+void line_to_san(struct host_engine *h, struct mate_search *ms, char *out)
+{
+    struct host_move list[MAXMOVES];
+    char san[16];
+    int n, i;
+    unsigned char ply;
+
+    out[0] = 0;
+
+    for(ply = 0; ply < ms->line_length; ply++)
+    {
+        n = generate_legal(h, list);
+        for(i = 0; i < n; i++)
+            if(list[i].move.src == ms->line[ply].src && list[i].move.dst == ms->line[ply].dst)
+                break;
+        if(i == n)
+            break;
+
+        move_to_san(h, &list[i], list, n, san);
+        if(ply)
+            strcat(out, " ");
+        strcat(out, san);
+        play_move(&h->engine, list[i].move);
+    }
+}
+
+void usage(void)
+{
+    fprintf(stderr, "usage: geochess-mate [-m moves] [-c] [-n nodes] [-t ms] [-H mb] file.epd\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    struct host_engine *h = malloc(sizeof(struct host_engine));
+    struct mate_search *ms = calloc(1, sizeof(struct mate_search));
+    unsigned long hash_mb = 64, entries = 1, total_nodes = 0, total_ms = 0, ms_taken;
+    int max_moves = 3, moves, opt, count = 0, found = 0, targets = 0, solved = 0, dm;
+    char line[MAXLINE], id[64], text[MAXLINE], *op;
+    unsigned char result;
+    FILE *f;
+
+    while((opt = getopt(argc, argv, "m:cn:t:H:")) != -1)
+    {
+        switch(opt)
+        {
+            case 'm': max_moves = atoi(optarg); break;
+            case 'c': ms->checks_only = 1; break;
+            case 'n': node_limit = strtoul(optarg, 0, 10); break;
+            case 't': time_limit = strtoul(optarg, 0, 10); break;
+            case 'H': hash_mb = strtoul(optarg, 0, 10); break;
+            default: usage();
+        }
+    }
+
+    if(optind >= argc || max_moves < 1)
+        usage();
+
+    if(!(f = fopen(argv[optind], "r")))
+    {
+        fprintf(stderr, "geochess-mate: cannot open '%s'\n", argv[optind]);
+        return 1;
+    }
+
+    while((entries * 2 * sizeof(struct mate_entry)) <= hash_mb * 1024 * 1024)
+        entries *= 2;
+    ms->table = malloc(entries * sizeof(struct mate_entry));
+    ms->mask = entries - 1;
+    ms->limit = node_limit;
+    ms->progress = mate_progress;
+    host_init(h);
+
+    while(fgets(line, sizeof(line), f))
+    {
+        line[strcspn(line, "\r\n")] = 0;
+        if(!line[0] || line[0] == '#' || set_fen(h, line))
+            continue;
+
+        count++;
+        sprintf(id, "#%d", count);
+        if((op = strstr(line, "id \"")))
+        {
+            strncpy(id, op + 4, sizeof(id) - 1);
+            id[sizeof(id) - 1] = 0;
+            id[strcspn(id, "\"")] = 0;
+        }
+
+        moves = max_moves;
+        dm = 0;
+        if((op = strstr(line, "dm ")))
+        {
+            dm = atoi(op + 3);
+            if(dm > 0)
+            {
+                moves = dm;
+                targets++;
+            }
+        }
+
+        started = host_ticks();
+        result = mate_solve(&h->engine, ms, moves);
+        ms_taken = host_ticks() - started;
+        total_nodes += ms->nodes;
+        total_ms += ms_taken;
+
+        if(result == MATE_FOUND)
+        {
+            found++;
+            if(dm > 0 && ms->moves == dm)
+                solved++;
+            line_to_san(h, ms, text);
+            printf("%-16s mate in %-3d %-40s", id, ms->moves, text);
+        }
+        else if(result == MATE_NONE)
+        {
+            sprintf(text, ms->checks_only ? "no mate in %d by checks" : "no mate in %d", ms->moves);
+            printf("%-16s %-52s", id, text);
+        }
+        else
+            printf("%-16s %-52s", id, "unknown");
+
+        printf(" %10lu nodes %7lu ms\n", ms->nodes, ms_taken);
+        fflush(stdout);
+    }
+
+    fclose(f);
+
+    printf("\n%d positions, %d mates found", count, found);
+    if(targets)
+        printf(", %d of %d dm solved", solved, targets);
+    printf("  (%lu nodes, %lu ms)\n", total_nodes, total_ms);
+
+    free(ms->table);
+    free(ms);
+    host_release(h);
+    free(h);
+    return 0;
+}
@@ -0,0 +1,365 @@
+//===================================================================================
+//
+//                                  GEOCHESS
+//
+// geoChess is a chess game for GEOS under the Commodore 64 and 128 computers
+//
+// Written by Scott Hutter
+// Nov 2023
+//
+// You are free to modify this code as desired, as long as original author credit
+// is mentioned for both the geos code and the included AI engines
+//===================================================================================
+
+//*********************************************************************************
+//
+// Mate-in-N solver: a depth-first proof-number search (df-pn) over the
+// engine's legal moves.  The side to move is the attacker.  Its nodes are
+// proven by one move that leads to mate, the defender's only when every
+// reply does; each node carries a proof and a disproof number, the moves
+// still needed to settle it either way, and the search always expands the
+// most proving child within thresholds passed down from its parent.
+//
+// Nodes go in a table of struct mate_entry by position and attacker moves
+// left.  The caller sizes it to the memory it has, any power of two; a
+// small table only costs re-searching.  With checks_only the attacker
+// tries checking moves alone, which finds most composed and practical
+// mates far faster but proves only that there is no mate by checks.
+//
+// mate_solve() tries one move, two, ... up to the limit, so the first mate
+// found is the shortest.  The GEOS build loads it as an overlay of its own;
+// the moves it makes come from the engine's resident move generation.
+//
+//********************************************************************************
+
+#ifndef GEOCHESS_MATE_H
+#define GEOCHESS_MATE_H
+
+#include <string.h>
+#include "geochess-ai.h"
+
+// proof and disproof numbers stop here
+#define MATE_INF        ((~0u) >> 2)
+
+// room on the move stack for one node's moves and a reply list
+#define MATE_GEN_ROOM   160
+
+// mate_solve() results
+#define MATE_FOUND      0
+#define MATE_NONE       1           // proven: no mate within the limit
+#define MATE_UNKNOWN    2           // stopped, or the position is not legal
+
+#ifdef ENGINE_HASH
+typedef hash_key mate_key;
+#else
+typedef unsigned long mate_key;
+#endif
+
+struct mate_entry {
+    mate_key key;
+    unsigned int pn, dn;            // proof and disproof numbers
+    struct move move;               // the mating move, or the defence tried last
+    unsigned char left;             // attacker moves left, 0 = unused
+};
+
+struct mate_search {
+    struct mate_entry *table;
+    unsigned long mask;             // entries - 1, a power of two less one
+    unsigned char checks_only;
+    unsigned long limit;            // nodes, 0 = none
+    void (*progress)(struct mate_search *ms);   // every 256 nodes, may set stop
+    void *user;
+
+    // results
+    unsigned long nodes;
+    unsigned char stop;
+    unsigned char moves;            // of the mate found, or the limit proven
+    struct move line[MAX_PLY];      // the mating line, attacker first
+    unsigned char line_length;
+
+    // numbers of the moves on the engine's move stack
+    unsigned int pn[MOVE_STACK], dn[MOVE_STACK];
+};
+
+#ifndef MATE_OVERLAY
+#define MATE_OVERLAY    0
+#endif
+
+#if MATE_OVERLAY
+#pragma code-name(push, "OVERLAY5")
+#pragma rodata-name(push, "OVERLAY5")
+#endif
+
+// the key of the position, side to move, castling and en passant
+mate_key mate_position_key(ENGINE_PARAM_ int side)
+{
+#ifdef ENGINE_HASH
+    (void)side;
+    return ENG.hash;
+#else
+    mate_key key = side ^ (ENG.castle << 8) ^ ((unsigned long)ENG.ep << 16);
+    unsigned char sq;
+
+    for(sq = 0; sq < 128; sq++)
+    {
+        if(!(sq & 0x88))
+            key = ((key << 5) + key) ^ ENG.board[sq];
+    }
+
+    return key;
+#endif
+}
+
+// Legal moves of side at the end of the move stack, checks alone if the
+// attacker is to move and only checks count.  Stops after the first move
+// when first_only is set.  Returns the count, or KING_CAPTURE when side
+// could take the enemy king.
+unsigned char mate_moves(ENGINE_PARAM_ struct mate_search *ms, int side, unsigned char attacker, unsigned char first_only)
+{
+    struct move *list = &ENG.move_stack[ENG.move_sp];
+    unsigned char count, kept = 0, i;
+
+    count = GenerateMoves(ENGINE_ARG_ side, list);
+    if(count == KING_CAPTURE)
+        return KING_CAPTURE;
+    count = generate_special(ENGINE_ARG_ side, list, count);
+
+    for(i = 0; i < count; i++)
+    {
+        make_move(ENGINE_ARG_ list[i]);
+
+        if(GenerateMoves(ENGINE_ARG_ 24 - side, list + count) != KING_CAPTURE
+            && (!attacker || !ms->checks_only || GenerateMoves(ENGINE_ARG_ side, list + count) == KING_CAPTURE))
+            list[kept++] = list[i];
+
+        unmake_move(ENGINE_ARG_ list[i]);
+
+        if(kept && first_only)
+            break;
+    }
+
+    return kept;
+}
+
+struct mate_entry *mate_probe(struct mate_search *ms, mate_key key)
+{
+    return &ms->table[(unsigned int)key & ms->mask];
+}
+
+// Keep a node's numbers.  A settled node is not pushed out by an open one,
+// the mating line is read back from them.
+void mate_store(struct mate_search *ms, mate_key key, unsigned char left, unsigned int pn, unsigned int dn, struct move move)
+{
+    struct mate_entry *entry = mate_probe(ms, key);
+
+    // the defender's last move is not worth an entry
+    if(!left)
+        return;
+    if(entry->left && entry->key != key && (!entry->pn || !entry->dn) && pn && dn)
+        return;
+
+    entry->key = key;
+    entry->left = left;
+    entry->pn = pn;
+    entry->dn = dn;
+    entry->move = move;
+}
+
+// Expand the node of side to move, with left attacker moves to go, until
+// its numbers reach a threshold, and return them in *pn and *dn.
+void mate_mid(ENGINE_PARAM_ struct mate_search *ms, int side, unsigned char attacker, unsigned char left,
+    unsigned int th_pn, unsigned int th_dn, unsigned int *pn, unsigned int *dn)
+{
+    mate_key key = mate_position_key(ENGINE_ARG_ side);
+    struct mate_entry *entry = mate_probe(ms, key);
+    unsigned int first = ENG.move_sp;
+    unsigned int sum, least, second, child_pn, child_dn;
+    unsigned char count, i, best;
+    struct move move;
+
+    // a mate in fewer moves will do, and no mate in more rules out fewer
+    if(entry->left && entry->key == key
+        && (entry->left == left || (!entry->pn && entry->left < left) || (!entry->dn && entry->left > left))
+        && (entry->pn >= th_pn || entry->dn >= th_dn))
+    {
+        *pn = entry->pn;
+        *dn = entry->dn;
+        return;
+    }
+
+    if(!(++ms->nodes & 255) && ms->progress)
+        ms->progress(ms);
+    if((ms->limit && ms->nodes >= ms->limit) || ENG.move_sp + MATE_GEN_ROOM > MOVE_STACK)
+        ms->stop = 1;
+    if(ms->stop)
+    {
+        *pn = *dn = 1;
+        return;
+    }
+
+    // the defender's last chance needs one legal move to escape
+    count = mate_moves(ENGINE_ARG_ ms, side, attacker, !attacker && !left);
+    move.src = move.dst = 0xff;
+
+    if(!count || count == KING_CAPTURE)
+    {
+        // mated when the attacker could take the king, stalemate otherwise
+        if(!attacker && GenerateMoves(ENGINE_ARG_ 24 - side, &ENG.move_stack[first]) == KING_CAPTURE)
+            *pn = 0, *dn = MATE_INF;
+        else
+            *pn = MATE_INF, *dn = 0;
+        mate_store(ms, key, left, *pn, *dn, move);
+        return;
+    }
+
+    if(!attacker && !left)
+    {
+        *pn = MATE_INF, *dn = 0;
+        mate_store(ms, key, left, *pn, *dn, move);
+        return;
+    }
+
+    ENG.move_sp += count;
+    for(i = 0; i < count; i++)
+        ms->pn[first + i] = ms->dn[first + i] = 1;
+
+    for(;;)
+    {
+        // the attacker needs one child proven, the defender one disproven;
+        // sum is the other number, least and second the two smallest
+        sum = 0;
+        least = second = MATE_INF;
+        best = 0;
+        for(i = 0; i < count; i++)
+        {
+            child_pn = attacker ? ms->pn[first + i] : ms->dn[first + i];
+            child_dn = attacker ? ms->dn[first + i] : ms->pn[first + i];
+
+            if((sum += child_dn) >= MATE_INF)
+                sum = MATE_INF;
+
+            if(child_pn < least)
+            {
+                second = least;
+                least = child_pn;
+                best = i;
+            }
+            else if(child_pn < second)
+                second = child_pn;
+        }
+
+        *pn = attacker ? least : sum;
+        *dn = attacker ? sum : least;
+        move = ENG.move_stack[first + best];
+
+        if(*pn >= th_pn || *dn >= th_dn || ms->stop)
+            break;
+
+        // the best child may use what its parent has up to the threshold,
+        // or until it stops being the best
+        if(attacker)
+        {
+            child_pn = (second + 1 < th_pn) ? second + 1 : th_pn;
+            child_dn = (th_dn >= MATE_INF) ? MATE_INF : th_dn - sum + ms->dn[first + best];
+        }
+        else
+        {
+            child_dn = (second + 1 < th_dn) ? second + 1 : th_dn;
+            child_pn = (th_pn >= MATE_INF) ? MATE_INF : th_pn - sum + ms->pn[first + best];
+        }
+
+        make_move(ENGINE_ARG_ move);
+        mate_mid(ENGINE_ARG_ ms, 24 - side, !attacker, attacker ? left - 1 : left, child_pn, child_dn,
+            &ms->pn[first + best], &ms->dn[first + best]);
+        unmake_move(ENGINE_ARG_ move);
+    }
+
+    ENG.move_sp = first;
+    if(!ms->stop)
+        mate_store(ms, key, left, *pn, *dn, move);
+}
+
+// Follow the stored moves from the root while they are proven, legal and
+// not past the mate.
+void mate_read_line(ENGINE_PARAM_ struct mate_search *ms, int side)
+{
+    struct mate_entry *entry;
+    mate_key key;
+    unsigned char attacker = 1, count, i;
+
+    ms->line_length = 0;
+
+    while(ms->line_length < 2 * ms->moves - 1)
+    {
+        key = mate_position_key(ENGINE_ARG_ side);
+        entry = mate_probe(ms, key);
+        if(!entry->left || entry->key != key || entry->pn || entry->move.src == 0xff)
+            break;
+
+        count = mate_moves(ENGINE_ARG_ ms, side, attacker, 0);
+        for(i = 0; i < count && count != KING_CAPTURE; i++)
+            if(ENG.move_stack[ENG.move_sp + i].src == entry->move.src && ENG.move_stack[ENG.move_sp + i].dst == entry->move.dst)
+                break;
+        if(count == KING_CAPTURE || i == count)
+            break;
+
+        ms->line[ms->line_length++] = entry->move;
+        make_move(ENGINE_ARG_ entry->move);
+        side = 24 - side;
+        attacker = !attacker;
+    }
+
+    for(i = ms->line_length; i--; )
+        unmake_move(ENGINE_ARG_ ms->line[i]);
+}
+
+// Look for a mate by the side to move in at most moves moves.  The table
+// is cleared first.
+unsigned char mate_solve(ENGINE_PARAM_ struct mate_search *ms, unsigned char moves)
+{
+    unsigned int pn, dn;
+    unsigned char n;
+    int side = ENG.side;
+
+    // a mate in n makes 2n - 1 moves, and the legality test one more
+    if(moves > MAX_PLY / 2)
+        moves = MAX_PLY / 2;
+
+    memset(ms->table, 0, (ms->mask + 1) * sizeof(struct mate_entry));
+    ms->nodes = 0;
+    ms->stop = 0;
+    ms->moves = 0;
+    ms->line_length = 0;
+    ENG.move_sp = 0;
+    ENG.undo_sp = 0;
+#ifdef ENGINE_HASH
+    ENG.hash = hash_position(ENGINE_ARG_ side);
+#endif
+
+    // a side that can take the king is not in a legal position
+    if(GenerateMoves(ENGINE_ARG_ side, ENG.move_stack) == KING_CAPTURE)
+        return MATE_UNKNOWN;
+
+    for(n = 1; n <= moves; n++)
+    {
+        mate_mid(ENGINE_ARG_ ms, side, 1, n, MATE_INF, MATE_INF, &pn, &dn);
+        if(ms->stop)
+            return MATE_UNKNOWN;
+
+        ms->moves = n;
+        if(!pn)
+        {
+            mate_read_line(ENGINE_ARG_ ms, side);
+            return MATE_FOUND;
+        }
+    }
+
+    return MATE_NONE;
+}
+
+#if MATE_OVERLAY
+#pragma rodata-name(pop)
+#pragma code-name(pop)
+#endif
+
+#endif
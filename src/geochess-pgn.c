@@ -0,0 +1,551 @@
+//===================================================================================
+//
+//                                  GEOCHESS
+//
+// geoChess is a chess game for GEOS under the Commodore 64 and 128 computers
+//
+// Written by Scott Hutter
+// Nov 2023
+//
+// You are free to modify this code as desired, as long as original author credit
+// is mentioned for both the geos code and the included AI engines
+//===================================================================================
+
+//*********************************************************************************
+//
+// PGN annotator.  Replays every game of one or more PGN files through the
+// engine, searching the position before each move, and writes the games back
+// with the engine's score and preferred move as comments and variations, or
+// (-e) one EPD record per position:
+//
+//   <position> bm <engine's move>; ce <cp>; acd <depth>; c9 "<result>"; id "<game>.<ply>";
+//
+// which geochess-tune reads as it is.
+//
+// geochess-pgn [-n nodes] [-t ms] [-d depth] [-j workers] [-H mb] [-e] [-o out] file.pgn ...
+//
+// The files are memory-mapped and read in place: the main thread only finds
+// where each game starts and hands it to the workers through a ring of
+// QUEUE slots, and the moves are parsed from the mapping by the worker.  A
+// slot is reused once its game has been written, and games are written in
+// their input order, so memory use stays the same however large the input.
+// Without a limit every position is searched to depth 4.
+//
+//********************************************************************************
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "geochess-host.h"
+
+#define QUEUE       64              // games in flight
+#define LINEWIDTH   79              // of the PGN written
+
+#define SLOT_FREE       0
+#define SLOT_QUEUED     1
+#define SLOT_RUNNING    2
+#define SLOT_DONE       3
+
+struct pgn_game {
+    const char *text;               // in the mapping, not terminated
+    size_t length;
+    unsigned long number;
+    int state;
+
+    // what is written for it, kept between games
+    char *out;
+    size_t out_length, out_capacity;
+    int column;
+};
+
+struct pgn_game slots[QUEUE];
+unsigned long queued = 0;           // games handed to the ring
+unsigned long taken = 0;            // games a worker has started
+unsigned long written = 0;          // games written out
+int input_done = 0;
+
+pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t game_queued = PTHREAD_COND_INITIALIZER;
+pthread_cond_t game_done = PTHREAD_COND_INITIALIZER;
+
+struct search_limits limits;
+unsigned long hash_mb = 0;
+int epd_output = 0;
+FILE *out;
+
+void append(struct pgn_game *g, const char *format, ...)
+{
+    va_list args;
+    int length;
+
+    for(;;)
+    {
+        va_start(args, format);
+        length = vsnprintf(g->out + g->out_length, g->out_capacity - g->out_length, format, args);
+        va_end(args);
+
+        if(g->out_length + length < g->out_capacity)
+            break;
+
+        g->out_capacity = (g->out_capacity + length) * 2;
+        if(!(g->out = realloc(g->out, g->out_capacity)))
+        {
+            fprintf(stderr, "geochess-pgn: out of memory\n");
+            exit(1);
+        }
+    }
+
+    g->out_length += length;
+}
+
+// a word of movetext, wrapped at LINEWIDTH
+void append_word(struct pgn_game *g, const char *word)
+{
+    int length = strlen(word);
+
+    if(g->column && g->column + 1 + length > LINEWIDTH)
+    {
+        append(g, "\n");
+        g->column = 0;
+    }
+
+    append(g, g->column ? " %s" : "%s", word);
+    g->column += length + (g->column ? 1 : 0);
+}
+
+// the next tag line, skipping blank lines, or 0 where the movetext starts
+const char *next_tag(const char *p, const char *end)
+{
+    while(p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n'))
+        p++;
+
+    return (p < end && *p == '[') ? p : 0;
+}
+
+// value of a tag such as [Result "1-0"], copied into value
+int find_tag(const char *p, const char *end, const char *name, char *value, int size)
+{
+    int length = strlen(name);
+    const char *q;
+
+    for(; (p = next_tag(p, end)); p = q + 1)
+    {
+        if(!(q = memchr(p, '\n', end - p)))
+            q = end;
+
+        if(q - p > length + 2 && !memcmp(p + 1, name, length) && p[length + 1] == ' ')
+        {
+            p += length + 2;
+            while(p < q && *p != '"')
+                p++;
+            for(++p; p < q && *p != '"' && size > 1; size--)
+                *value++ = *p++;
+            *value = 0;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+// Next move of the movetext in a buffer, skipping move numbers, comments,
+// variations and NAGs.  Returns 0 at the end of the game.
+int next_move(const char **text, const char *end, char *move)
+{
+    const char *p = *text;
+    int depth, length;
+
+    for(;;)
+    {
+        while(p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n' || *p == '.'))
+            p++;
+        if(p >= end)
+            break;
+
+        if(*p == '{')
+        {
+            while(p < end && *p != '}')
+                p++;
+            p++;
+        }
+        else if(*p == ';' || (*p == '%' && (p == *text || p[-1] == '\n')))
+        {
+            while(p < end && *p != '\n')
+                p++;
+        }
+        else if(*p == '(')
+        {
+            for(depth = 0; p < end; p++)
+            {
+                if(*p == '(')
+                    depth++;
+                else if(*p == ')' && !--depth)
+                    break;
+                else if(*p == '{')
+                    while(p < end && *p != '}')
+                        p++;
+            }
+            p++;
+        }
+        else if(*p == '$' || (*p >= '0' && *p <= '9'))
+        {
+            // results end the game, move numbers and NAGs are skipped
+            if(*p != '$' && end - p >= 3 && (!memcmp(p, "1-0", 3) || !memcmp(p, "0-1", 3) || !memcmp(p, "1/2", 3)))
+                break;
+            p++;
+            while(p < end && *p >= '0' && *p <= '9')
+                p++;
+        }
+        else if(*p == '*')
+            break;
+        else
+        {
+            for(length = 0; p < end && !strchr(" \t\r\n{}();", *p); p++)
+                if(length < 15)
+                    move[length++] = *p;
+            move[length] = 0;
+            *text = p;
+            return 1;
+        }
+    }
+
+    *text = end;
+    return 0;
+}
+
+// score in pawns from white's point of view
+void score_text(struct host_engine *h, int score, int depth, char *text)
+{
+    if(h->engine.side == 16)
+        score = -score;
+
+    sprintf(text, "{%c%d.%02d/%d}", score < 0 ? '-' : '+', abs(score) / 100, abs(score) % 100, depth);
+}
+
+void annotate(struct host_engine *h, struct pgn_game *g)
+{
+    const char *end = g->text + g->length;
+    const char *p = g->text, *tag;
+    struct host_move list[MAXMOVES];
+    char fen[128], result[16], move[16], san[16], best[16], epd[128];
+    char number[16], comment[32], word[64];
+    struct move best_move;
+    int n, m, i, score, depth, ply = 0, move_number = 1;
+
+    g->out_length = 0;
+    g->column = 0;
+    if(g->out)
+        g->out[0] = 0;
+
+    if(!find_tag(p, end, "Result", result, sizeof(result)))
+        strcpy(result, "*");
+
+    if(!find_tag(p, end, "FEN", fen, sizeof(fen)) || set_fen(h, fen))
+        set_fen(h, STARTPOS);
+    else if(strrchr(fen, ' ') && atoi(strrchr(fen, ' ')) > 0)
+        move_number = atoi(strrchr(fen, ' '));
+
+    host_clear_hash(h);
+
+    // the tag lines are copied as they are
+    while((tag = next_tag(p, end)))
+    {
+        if(!(p = memchr(tag, '\n', end - tag)))
+            p = end;
+        else
+            p++;
+        if(!epd_output)
+            append(g, "%.*s", (int)(p - tag), tag);
+    }
+    if(!epd_output)
+        append(g, "\n");
+
+    while(next_move(&p, end, move))
+    {
+        n = generate_legal(h, list);
+        if((m = find_move(h, move, list, n)) < 0)
+        {
+            if(!epd_output)
+            {
+                snprintf(word, sizeof(word), "{illegal move %s}", move);
+                append_word(g, word);
+            }
+            break;
+        }
+
+        h->limits = limits;
+        score = search_best(h, &best_move);
+        depth = h->engine.stats.depth;
+
+        best[0] = 0;
+        for(i = 0; i < n; i++)
+            if(list[i].move.src == best_move.src && list[i].move.dst == best_move.dst)
+                move_to_san(h, &list[i], list, n, best);
+
+        move_to_san(h, &list[m], list, n, san);
+
+        if(epd_output)
+        {
+            get_epd(h, epd);
+            append(g, "%s bm %s; ce %d; acd %d; c9 \"%s\"; id \"%lu.%d\";\n",
+                epd, best[0] ? best : san, score, depth, result, g->number, ply + 1);
+        }
+        else
+        {
+            // every move is followed by a comment, so black's need numbers too
+            snprintf(number, sizeof(number), h->engine.side == 8 ? "%d." : "%d...", move_number);
+            append_word(g, number);
+            append_word(g, san);
+
+            // the score goes with the engine's move, a variation if it differs
+            score_text(h, score, depth, comment);
+            if(best[0] && strcmp(best, san))
+            {
+                snprintf(word, sizeof(word), "(%s %s", number, best);
+                append_word(g, word);
+                snprintf(word, sizeof(word), "%s)", comment);
+                append_word(g, word);
+            }
+            else
+                append_word(g, comment);
+        }
+
+        if(h->engine.side == 16)
+            move_number++;
+        play_move(&h->engine, list[m].move);
+        ply++;
+    }
+
+    if(!epd_output)
+    {
+        append_word(g, result);
+        append(g, "\n\n");
+    }
+}
+
+void *run_worker(void *arg)
+{
+    struct host_engine *h = malloc(sizeof(struct host_engine));
+    struct pgn_game *g;
+
+    host_init(h);
+    host_set_hash(h, hash_mb);
+
+    for(;;)
+    {
+        pthread_mutex_lock(&lock);
+        while(taken == queued && !input_done)
+            pthread_cond_wait(&game_queued, &lock);
+        if(taken == queued)
+        {
+            pthread_mutex_unlock(&lock);
+            break;
+        }
+        g = &slots[taken++ % QUEUE];
+        g->state = SLOT_RUNNING;
+        pthread_mutex_unlock(&lock);
+
+        annotate(h, g);
+
+        pthread_mutex_lock(&lock);
+        g->state = SLOT_DONE;
+        pthread_cond_signal(&game_done);
+        pthread_mutex_unlock(&lock);
+    }
+
+    host_release(h);
+    free(h);
+    return arg;
+}
+
+// write the finished games at the front of the ring, with the lock held
+void write_done(void)
+{
+    struct pgn_game *g;
+
+    while(written < queued && (g = &slots[written % QUEUE])->state == SLOT_DONE)
+    {
+        fwrite(g->out, 1, g->out_length, out);
+        g->state = SLOT_FREE;
+        written++;
+    }
+}
+
+// hand one game to the workers, waiting for a free slot
+void queue_game(const char *text, size_t length)
+{
+    struct pgn_game *g;
+
+    pthread_mutex_lock(&lock);
+
+    for(;;)
+    {
+        write_done();
+        if((g = &slots[queued % QUEUE])->state == SLOT_FREE)
+            break;
+        pthread_cond_wait(&game_done, &lock);
+    }
+
+    g->text = text;
+    g->length = length;
+    g->number = queued + 1;
+    g->state = SLOT_QUEUED;
+    queued++;
+
+    pthread_cond_signal(&game_queued);
+    pthread_mutex_unlock(&lock);
+}
+
+// Split a file into games.  A game ends where a tag line follows movetext;
+// braces are followed so a comment cannot start a game.  Returns the number
+// of games.
+unsigned long queue_file(const char *data, size_t size)
+{
+    const char *end = data + size;
+    const char *p = data, *game = 0, *line_end;
+    unsigned long games = 0;
+    int movetext = 0, comment = 0;
+
+    for(; p < end; p = line_end + 1)
+    {
+        if(!(line_end = memchr(p, '\n', end - p)))
+            line_end = end;
+
+        if(!comment && *p == '[')
+        {
+            if(game && movetext)
+            {
+                queue_game(game, p - game);
+                games++;
+                game = 0;
+            }
+            if(!game)
+                game = p;
+            movetext = 0;
+            continue;
+        }
+
+        for(; p < line_end; p++)
+        {
+            if(*p == '{')
+                comment = 1;
+            else if(*p == '}')
+                comment = 0;
+            else if(!comment && *p != ' ' && *p != '\t' && *p != '\r')
+            {
+                if(!game)
+                    game = p;
+                movetext = 1;
+            }
+        }
+    }
+
+    if(game && movetext)
+    {
+        queue_game(game, end - game);
+        games++;
+    }
+
+    return games;
+}
+
+void usage(void)
+{
+    fprintf(stderr, "usage: geochess-pgn [-n nodes] [-t ms] [-d depth] [-j workers] [-H mb] [-e] [-o out] file.pgn ...\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    int workers = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    const char *out_name = 0;
+    const char *data;
+    pthread_t *threads;
+    unsigned long games = 0;
+    struct stat st;
+    int opt, fd, i;
+
+    while((opt = getopt(argc, argv, "n:t:d:j:H:eo:")) != -1)
+    {
+        switch(opt)
+        {
+            case 'n': limits.nodes = strtoul(optarg, 0, 10); break;
+            case 't': limits.movetime = strtoul(optarg, 0, 10); break;
+            case 'd': limits.depth = atoi(optarg); break;
+            case 'j': workers = atoi(optarg); break;
+            case 'H': hash_mb = strtoul(optarg, 0, 10); break;
+            case 'e': epd_output = 1; break;
+            case 'o': out_name = optarg; break;
+            default: usage();
+        }
+    }
+
+    if(optind >= argc)
+        usage();
+
+    if(!limits.nodes && !limits.movetime && !limits.depth)
+        limits.depth = 4;
+    if(workers < 1)
+        workers = 1;
+
+    out = stdout;
+    if(out_name && !(out = fopen(out_name, "w")))
+    {
+        fprintf(stderr, "geochess-pgn: cannot write '%s'\n", out_name);
+        return 1;
+    }
+
+    threads = malloc(workers * sizeof(pthread_t));
+    for(i = 0; i < workers; i++)
+        pthread_create(&threads[i], 0, run_worker, 0);
+
+    for(; optind < argc; optind++)
+    {
+        if((fd = open(argv[optind], O_RDONLY)) < 0 || fstat(fd, &st))
+        {
+            fprintf(stderr, "geochess-pgn: cannot read '%s'\n", argv[optind]);
+            continue;
+        }
+
+        if(st.st_size && (data = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) != MAP_FAILED)
+        {
+            madvise((void *)data, st.st_size, MADV_SEQUENTIAL);
+            games += queue_file(data, st.st_size);
+
+            // the workers read the mapping, so it stays until its games are written
+            pthread_mutex_lock(&lock);
+            while(written < queued)
+            {
+                write_done();
+                if(written < queued)
+                    pthread_cond_wait(&game_done, &lock);
+            }
+            pthread_mutex_unlock(&lock);
+
+            munmap((void *)data, st.st_size);
+        }
+        close(fd);
+    }
+
+    pthread_mutex_lock(&lock);
+    input_done = 1;
+    pthread_cond_broadcast(&game_queued);
+    pthread_mutex_unlock(&lock);
+
+    for(i = 0; i < workers; i++)
+        pthread_join(threads[i], 0);
+    free(threads);
+
+    for(i = 0; i < QUEUE; i++)
+        free(slots[i].out);
+
+    if(out != stdout)
+        fclose(out);
+
+    fprintf(stderr, "%lu games\n", games);
+    return 0;
+}
@@ -0,0 +1,160 @@
+//===================================================================================
+//
+//                                  GEOCHESS
+//
+// geoChess is a chess game for GEOS under the Commodore 64 and 128 computers
+//
+// Written by Scott Hutter
+// Nov 2023
+//
+// You are free to modify this code as desired, as long as original author credit
+// is mentioned for both the geos code and the included AI engines
+//===================================================================================
+
+//*********************************************************************************
+//
+// Phase timing probes.  PROBE_BEGIN()/PROBE_END() around a phase add its
+// time to the current entry of a ring buffer, which PROBE_NEXT() closes
+// after each move, so the last PROBE_MOVES moves can be shown from the
+// menu.  Each entry keeps the total time of every phase and its longest
+// single run.  Phases nest: input handling includes everything below it.
+//
+// Build with -DPHASE_PROBES to get them; otherwise the macros are empty and
+// nothing is compiled in.  The GEOS build counts 1 MHz cycles on the CIA #2
+// timers, chained to 32 bits; the host stand-in build reads the monotonic
+// clock in microseconds.
+//
+//********************************************************************************
+
+#ifndef GEOCHESS_PROBE_H
+#define GEOCHESS_PROBE_H
+
+#define PHASE_INPUT     0       // MouseClickHandler
+#define PHASE_VALIDATE  1       // isMoveIsValid
+#define PHASE_ENGINE    2       // the engine's search
+#define PHASE_DRAW      3       // MovePiece and InitBoard
+#define PHASE_DISK      4       // fonts and overlays
+#define PHASE_COUNT     5
+
+#ifdef PHASE_PROBES
+
+#define PROBE_MOVES     8
+
+#define PROBE_INIT()        probe_init()
+#define PROBE_BEGIN(phase)  probe_begin(phase)
+#define PROBE_END(phase)    probe_end(phase)
+#define PROBE_NEXT()        probe_next()
+
+struct probe_entry {
+    unsigned long total[PHASE_COUNT];
+    unsigned long longest[PHASE_COUNT];
+};
+
+struct probe_entry probe_ring[PROBE_MOVES];
+unsigned char probe_current = 0;            // entry being filled
+unsigned char probe_moves = 0;              // entries closed, at most PROBE_MOVES
+unsigned long probe_start[PHASE_COUNT];
+
+#ifdef GEOS_HOST
+
+#include <time.h>
+
+#define PROBE_TICKS_PER_MS  1000UL
+
+void probe_init(void)
+{
+}
+
+unsigned long probe_ticks(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long)now.tv_sec * 1000000UL + now.tv_nsec / 1000;
+}
+
+#else
+
+// CIA #2 timer A counts cycles, timer B counts timer A's underflows
+#define CIA2_TA_LO      (*(volatile unsigned char *)0xdd04)
+#define CIA2_TA_HI      (*(volatile unsigned char *)0xdd05)
+#define CIA2_TB_LO      (*(volatile unsigned char *)0xdd06)
+#define CIA2_TB_HI      (*(volatile unsigned char *)0xdd07)
+#define CIA2_ICR        (*(volatile unsigned char *)0xdd0d)
+#define CIA2_CRA        (*(volatile unsigned char *)0xdd0e)
+#define CIA2_CRB        (*(volatile unsigned char *)0xdd0f)
+
+// the CIAs run at 1 MHz on both machines, close enough to 1000 per ms
+#define PROBE_TICKS_PER_MS  1000UL
+
+void probe_init(void)
+{
+    // no NMIs from the timers, both free running from $ffff
+    CIA2_ICR = 0x03;
+    CIA2_TA_LO = 0xff;
+    CIA2_TA_HI = 0xff;
+    CIA2_TB_LO = 0xff;
+    CIA2_TB_HI = 0xff;
+    CIA2_CRB = 0x51;
+    CIA2_CRA = 0x11;
+}
+
+// cycles since probe_init(), the timers count down.  Read again if timer B
+// or timer A's high byte moved while reading.
+unsigned long probe_ticks(void)
+{
+    unsigned int a, b;
+    unsigned char hi;
+
+    asm("sei");
+    do
+    {
+        b = CIA2_TB_LO | (CIA2_TB_HI << 8);
+        hi = CIA2_TA_HI;
+        a = CIA2_TA_LO | (CIA2_TA_HI << 8);
+    }
+    while((a >> 8) != hi || b != (CIA2_TB_LO | (CIA2_TB_HI << 8)));
+    asm("cli");
+
+    return ~(((unsigned long)b << 16) | a);
+}
+
+#endif
+
+void probe_begin(unsigned char phase)
+{
+    probe_start[phase] = probe_ticks();
+}
+
+void probe_end(unsigned char phase)
+{
+    struct probe_entry *entry = &probe_ring[probe_current];
+    unsigned long ticks = probe_ticks() - probe_start[phase];
+
+    entry->total[phase] += ticks;
+    if(ticks > entry->longest[phase])
+        entry->longest[phase] = ticks;
+}
+
+// close the entry of this move and start the next one
+void probe_next(void)
+{
+    if(++probe_current == PROBE_MOVES)
+        probe_current = 0;
+
+    if(probe_moves < PROBE_MOVES)
+        ++probe_moves;
+
+    memset(&probe_ring[probe_current], 0, sizeof(struct probe_entry));
+}
+
+#else
+
+#define PROBE_INIT()
+#define PROBE_BEGIN(phase)
+#define PROBE_END(phase)
+#define PROBE_NEXT()
+
+#endif
+
+#endif
@@ -0,0 +1,205 @@
+//===================================================================================
+//
+//                                  GEOCHESS
+//
+// geoChess is a chess game for GEOS under the Commodore 64 and 128 computers
+//
+// Written by Scott Hutter
+// Nov 2023
+//
+// You are free to modify this code as desired, as long as original author credit
+// is mentioned for both the geos code and the included AI engines
+//===================================================================================
+
+//*********************************************************************************
+//
+// UI replay driver.  Builds the whole of geochess.c against the host GEOS
+// stand-in of geos-host/, starts the program and feeds it a script of mouse
+// clicks and menu picks.  After each line the GEOS calls and pixels drawn are
+// printed, so redraw costs can be compared between versions, and snapshots
+// of the screen can be written or checked against golden images.
+//
+// geochess-replay [-m 64|40|80] [-d fontdir] [-w dir] [-g dir] [script]
+//
+//  -m      GEOS 64 (default), or GEOS 128 in 40 or 80 columns
+//  -d      where the font .cvt files are, default .
+//  -w      write every snapshot to dir/<name>.pbm
+//  -g      compare every snapshot with dir/<name>.pbm, exit 1 on a difference
+//
+// Script lines, read from the file or stdin, # starts a comment:
+//
+//  click e2        press and release on a square
+//  click x y       press and release at a screen position
+//  move e2 e4      two clicks, the player's move and the engine's answer
+//  menu engine     pick an item of the main menu or its submenus
+//  snap name       snapshot of the screen
+//
+//********************************************************************************
+
+#include <unistd.h>
+#include <geos.h>
+
+#define main geochess_main
+#include "geochess.c"
+#undef main
+
+const char *write_dir = 0;
+const char *golden_dir = 0;
+int differences = 0;
+
+// press and release in the middle of a square such as "e2"
+int click_square(const char *name)
+{
+    unsigned char row, col;
+    struct window *square;
+
+    if(strlen(name) != 2 || name[0] < 'a' || name[0] > 'h' || name[1] < '1' || name[1] > '8')
+        return 1;
+
+    col = name[0] - 'a';
+    row = '8' - name[1];
+    square = &vboard[row][col];
+
+    host_click((square->left + square->right) / 2, (square->top + square->bot) / 2);
+    return 0;
+}
+
+void snapshot(const char *name)
+{
+    char path[512];
+    long differ;
+
+    if(write_dir)
+    {
+        snprintf(path, sizeof(path), "%s/%s.pbm", write_dir, name);
+        if(host_write_pbm(path))
+            fprintf(stderr, "cannot write %s\n", path);
+    }
+
+    if(golden_dir)
+    {
+        snprintf(path, sizeof(path), "%s/%s.pbm", golden_dir, name);
+        differ = host_compare_pbm(path);
+
+        if(differ)
+        {
+            if(differ < 0)
+                printf("%s: no golden image %s\n", name, path);
+            else
+                printf("%s: %ld pixels differ from %s\n", name, differ, path);
+            ++differences;
+        }
+    }
+}
+
+// one script line, 0 if it was understood
+int run_line(char *line)
+{
+    char *command, *a, *b;
+
+    if((command = strchr(line, '#')))
+        *command = 0;
+
+    if(!(command = strtok(line, " \t\r\n")))
+        return 0;
+
+    a = strtok(0, " \t\r\n");
+    b = strtok(0, "\r\n");
+
+    if(!strcmp(command, "click") && a && b)
+    {
+        host_click(atoi(a), atoi(b));
+        return 0;
+    }
+
+    if(!strcmp(command, "click") && a)
+        return click_square(a);
+
+    if(!strcmp(command, "move") && a && b)
+    {
+        while(*b == ' ' || *b == '\t')
+            b++;
+        return click_square(a) || click_square(b);
+    }
+
+    // menu item names may hold blanks, e.g. "menu switch 40/80"
+    if(!strcmp(command, "menu") && a)
+    {
+        char name[64];
+
+        snprintf(name, sizeof(name), b ? "%s %s" : "%s", a, b);
+        return host_menu_select(name);
+    }
+
+    if(!strcmp(command, "snap") && a)
+    {
+        snapshot(a);
+        return 0;
+    }
+
+    return 1;
+}
+
+int main(int argc, char *argv[])
+{
+    static char *app_argv[] = { "GeoChess", 0 };
+    const char *font_dir = ".";
+    unsigned char os = GEOS64, columns80 = 0;
+    char line[256], label[32];
+    FILE *script = stdin;
+    int opt, number = 0;
+    size_t length;
+
+    while((opt = getopt(argc, argv, "m:d:w:g:")) != -1)
+    {
+        switch(opt)
+        {
+            case 'm':
+                os = strcmp(optarg, "64") ? GEOS128 : GEOS64;
+                columns80 = !strcmp(optarg, "80");
+                break;
+            case 'd': font_dir = optarg; break;
+            case 'w': write_dir = optarg; break;
+            case 'g': golden_dir = optarg; break;
+            default:
+                fprintf(stderr, "usage: geochess-replay [-m 64|40|80] [-d fontdir] [-w dir] [-g dir] [script]\n");
+                return 2;
+        }
+    }
+
+    if(optind < argc && !(script = fopen(argv[optind], "r")))
+    {
+        fprintf(stderr, "cannot open %s\n", argv[optind]);
+        return 2;
+    }
+
+    host_init(os, columns80, font_dir, app_argv[0]);
+    geochess_main(1, app_argv);
+    host_report(stdout, "startup");
+
+    while(fgets(line, sizeof(line), script))
+    {
+        ++number;
+
+        // the report is labelled with the line itself
+        length = strcspn(line, "#\r\n");
+        while(length && (line[length - 1] == ' ' || line[length - 1] == '\t'))
+            --length;
+        if(!length)
+            continue;
+        snprintf(label, sizeof(label), "%.*s", (int)length, line);
+
+        if(run_line(line))
+        {
+            fprintf(stderr, "line %d: cannot run %s\n", number, label);
+            fflush(stdout);
+            _exit(2);
+        }
+
+        host_report(stdout, label);
+    }
+
+    // leave without the program's atexit() handler, which frees GEOS' menu
+    fflush(stdout);
+    _exit(differences ? 1 : 0);
+}
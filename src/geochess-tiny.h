@@ -0,0 +1,380 @@
+//===================================================================================
+//
+//                                  GEOCHESS
+//
+// geoChess is a chess game for GEOS under the Commodore 64 and 128 computers
+//
+// Written by Scott Hutter
+// Nov 2023
+//
+// You are free to modify this code as desired, as long as original author credit
+// is mentioned for both the geos code and the included AI engines
+//===================================================================================
+
+//*********************************************************************************
+//
+// Tiny: a small, fast second engine behind the interface of geochess-engine.h.
+// It keeps the UI's piece codes on a 0x88 board, counts material only with a
+// little pull towards the centre, and looks TINY_DEPTH plies ahead.  Each
+// poll_search() call searches one root move.  Like BMCP it has no legality
+// test of its own: a line that lets the king be taken is scored as lost.
+// It plays the player's castling, en passant and promotions, but never
+// makes one itself other than to queen a pawn on the last row.
+//
+//********************************************************************************
+
+#ifndef GEOCHESS_TINY_H
+#define GEOCHESS_TINY_H
+
+#include <string.h>
+#include "geochess-engine.h"
+
+#ifndef TINY_DEPTH
+#define TINY_DEPTH      2
+#endif
+
+#define TINY_MAX_MOVES  100
+#define TINY_KING_TAKEN 255         // tiny_generate() result
+#define TINY_KING_VALUE 1000
+#define TINY_INFINITE   10000
+
+#define TINY_COLOUR(piece)  ((piece) >= BLK_KING ? BLK : WHT)
+
+// piece kinds, indexed by UI piece code
+#define TINY_KING       0
+#define TINY_QUEEN      1
+#define TINY_BISHOP     2
+#define TINY_KNIGHT     3
+#define TINY_ROOK       4
+#define TINY_PAWN       5
+
+static const unsigned char tiny_kinds[13] = { 0, 0, 1, 2, 3, 4, 5, 0, 1, 2, 3, 4, 5 };
+static const int tiny_values[6] = { 0, 90, 30, 30, 50, 10 };
+
+// step lists by kind, each ends with 0
+static const signed char tiny_steps[] = {
+    1, 16, -1, -16, 15, -15, 17, -17, 0,        // king, queen
+    15, -15, 17, -17, 0,                        // bishop
+    14, -14, 18, -18, 31, -31, 33, -33, 0,      // knight
+    1, 16, -1, -16, 0                           // rook
+};
+static const unsigned char tiny_first_step[5] = { 0, 0, 9, 14, 23 };
+
+unsigned char tiny_board[128];
+unsigned char tiny_side;
+struct chess_move tiny_moves[TINY_DEPTH + 1][TINY_MAX_MOVES];   // by remaining depth
+unsigned char tiny_root_count, tiny_root_next, tiny_best_index;
+int tiny_best_score;
+struct search_stats tiny_stats;
+
+#ifndef TINY_OVERLAY
+#define TINY_OVERLAY    0
+#endif
+
+#if TINY_OVERLAY
+#pragma code-name(push, "OVERLAY4")
+#pragma rodata-name(push, "OVERLAY4")
+#endif
+
+// moves of side, or TINY_KING_TAKEN
+unsigned char tiny_generate(unsigned char side, struct chess_move *list)
+{
+    unsigned char src, dst, piece, kind, i, count = 0;
+    signed char step;
+
+    for(src = 0; src < 128; src++)
+    {
+        if(src & 0x88)
+        {
+            src += 7;
+            continue;
+        }
+
+        piece = tiny_board[src];
+        if(!piece || TINY_COLOUR(piece) != side)
+            continue;
+
+        kind = tiny_kinds[piece];
+
+        if(kind == TINY_PAWN)
+        {
+            step = (side == WHT) ? -16 : 16;
+
+            // captures
+            for(i = 0; i < 2; i++)
+            {
+                dst = src + step + (i ? 1 : -1);
+                if(!(dst & 0x88) && tiny_board[dst] && TINY_COLOUR(tiny_board[dst]) != side)
+                {
+                    if(tiny_kinds[tiny_board[dst]] == TINY_KING) return TINY_KING_TAKEN;
+                    list[count].src = src;
+                    list[count].dst = dst;
+                    ++count;
+                }
+            }
+
+            // pushes, twice from the start row
+            dst = src + step;
+            if(!(dst & 0x88) && !tiny_board[dst])
+            {
+                list[count].src = src;
+                list[count].dst = dst;
+                ++count;
+
+                dst += step;
+                if((src >> 4) == ((side == WHT) ? 6 : 1) && !tiny_board[dst])
+                {
+                    list[count].src = src;
+                    list[count].dst = dst;
+                    ++count;
+                }
+            }
+
+            continue;
+        }
+
+        for(i = tiny_first_step[kind]; (step = tiny_steps[i]); i++)
+        {
+            dst = src;
+
+            do
+            {
+                dst += step;
+
+                if(dst & 0x88) break;
+                if(tiny_board[dst] && TINY_COLOUR(tiny_board[dst]) == side) break;
+                if(tiny_board[dst] && tiny_kinds[tiny_board[dst]] == TINY_KING) return TINY_KING_TAKEN;
+
+                list[count].src = src;
+                list[count].dst = dst;
+                ++count;
+            }
+
+            while(!tiny_board[dst] && kind != TINY_KING && kind != TINY_KNIGHT);
+        }
+    }
+
+    return count;
+}
+
+// distance from the edge, 0..6 over rows and columns
+unsigned char tiny_centre(unsigned char sq)
+{
+    unsigned char row = sq >> 4;
+    unsigned char col = sq & 7;
+
+    return (row < 4 ? row : 7 - row) + (col < 4 ? col : 7 - col);
+}
+
+// material won by a move, and a little for heading to the centre
+int tiny_gain(struct chess_move *move)
+{
+    unsigned char piece = tiny_board[move->src];
+    int gain = tiny_values[tiny_kinds[tiny_board[move->dst]]];
+
+    if(tiny_kinds[piece] != TINY_KING)
+        gain += tiny_centre(move->dst) - tiny_centre(move->src);
+
+    return gain;
+}
+
+// best gain of side over depth plies, less the opponent's best answer.
+// Taking the king ends the line.
+int tiny_search(unsigned char side, unsigned char depth, int alpha, int beta)
+{
+    struct chess_move *list = tiny_moves[depth];
+    unsigned char count, i, piece, captured;
+    int score, best = -TINY_INFINITE;
+
+    ++tiny_stats.nodes;
+
+    count = tiny_generate(side, list);
+    if(count == TINY_KING_TAKEN)
+        return TINY_KING_VALUE;
+
+    if(!count)
+        return 0;
+
+    for(i = 0; i < count; i++)
+    {
+        score = tiny_gain(&list[i]);
+
+        if(depth > 1)
+        {
+            piece = tiny_board[list[i].src];
+            captured = tiny_board[list[i].dst];
+            tiny_board[list[i].dst] = piece;
+            tiny_board[list[i].src] = EMPTY;
+
+            score -= tiny_search(1 - side, depth - 1, score - beta, score - alpha);
+
+            tiny_board[list[i].src] = piece;
+            tiny_board[list[i].dst] = captured;
+        }
+        else
+            ++tiny_stats.evals;
+
+        if(score > best)
+        {
+            best = score;
+            if(best > alpha)
+            {
+                alpha = best;
+                if(alpha >= beta)
+                {
+                    ++tiny_stats.cutoffs;
+                    if(!i)
+                        ++tiny_stats.first_cutoffs;
+                    break;
+                }
+            }
+        }
+    }
+
+    return best;
+}
+
+void tiny_make_move(struct chess_move *move)
+{
+    static const unsigned char promoted[4] = { WHT_KNIGHT, WHT_BISHOP, WHT_ROOK, WHT_QUEEN };
+    unsigned char src = MOVE_SQUARE(move->src);
+    unsigned char dst = MOVE_SQUARE(move->dst);
+    unsigned char piece = tiny_board[src];
+    unsigned char rook;
+
+    tiny_board[dst] = piece;
+    tiny_board[src] = EMPTY;
+
+    if(MOVE_FLAG(*move) == MOVE_CASTLE)
+    {
+        rook = (dst > src) ? src + 3 : src - 4;
+        tiny_board[(src + dst) >> 1] = tiny_board[rook];
+        tiny_board[rook] = EMPTY;
+    }
+    else if(MOVE_FLAG(*move) == MOVE_EP)
+        tiny_board[(src & 0x70) | (dst & 7)] = EMPTY;
+    else if(tiny_kinds[piece] == TINY_PAWN && (dst < 8 || dst >= 112))
+        tiny_board[dst] = ((MOVE_FLAG(*move) == MOVE_PROMOTE) ? promoted[PROMOTION_TYPE(*move) - 4] : WHT_QUEEN)
+            + (piece - WHT_PAWN);
+
+    tiny_side = 1 - tiny_side;
+}
+
+void tiny_set_position(unsigned char *squares, unsigned char side)
+{
+    unsigned char sq;
+
+    memset(tiny_board, 0, sizeof(tiny_board));
+
+    for(sq = 0; sq < 128; sq++)
+    {
+        if(!(sq & 0x88))
+            tiny_board[sq] = *squares++;
+    }
+
+    tiny_side = side;
+}
+
+void tiny_init(void)
+{
+    static const unsigned char back_rank[8] = { BLK_ROOK, BLK_KNIGHT, BLK_BISHOP, BLK_QUEEN, BLK_KING, BLK_BISHOP, BLK_KNIGHT, BLK_ROOK };
+    unsigned char col;
+
+    memset(tiny_board, 0, sizeof(tiny_board));
+
+    for(col = 0; col < 8; col++)
+    {
+        tiny_board[SQUARE(0, col)] = back_rank[col];
+        tiny_board[SQUARE(1, col)] = BLK_PAWN;
+        tiny_board[SQUARE(6, col)] = WHT_PAWN;
+        tiny_board[SQUARE(7, col)] = back_rank[col] - (BLK_KING - WHT_KING);
+    }
+
+    tiny_side = WHT;
+}
+
+void tiny_start_search(void)
+{
+    memset(&tiny_stats, 0, sizeof(tiny_stats));
+    tiny_stats.depth = TINY_DEPTH;
+    tiny_stats.start = ENGINE_TICKS();
+
+    tiny_root_count = tiny_generate(tiny_side, tiny_moves[TINY_DEPTH]);
+    tiny_root_next = 0;
+    tiny_best_score = -TINY_INFINITE;
+
+    // the opponent's king can be taken: the game is over
+    if(tiny_root_count == TINY_KING_TAKEN)
+        tiny_root_count = 0;
+}
+
+// one root move per call
+unsigned char tiny_poll_search(void)
+{
+    struct chess_move *move;
+    unsigned char piece, captured;
+    int score;
+
+    if(tiny_root_next < tiny_root_count)
+    {
+        move = &tiny_moves[TINY_DEPTH][tiny_root_next];
+        score = tiny_gain(move);
+
+        piece = tiny_board[move->src];
+        captured = tiny_board[move->dst];
+        tiny_board[move->dst] = piece;
+        tiny_board[move->src] = EMPTY;
+
+        score -= tiny_search(1 - tiny_side, TINY_DEPTH - 1, -TINY_INFINITE, score - tiny_best_score);
+
+        tiny_board[move->src] = piece;
+        tiny_board[move->dst] = captured;
+
+        if(score > tiny_best_score)
+        {
+            tiny_best_score = score;
+            tiny_best_index = tiny_root_next;
+        }
+
+        ++tiny_root_next;
+    }
+
+    if(tiny_root_next < tiny_root_count)
+        return SEARCH_RUNNING;
+
+    tiny_stats.elapsed = ENGINE_TICKS() - tiny_stats.start;
+    return SEARCH_DONE;
+}
+
+unsigned char tiny_get_best_move(struct chess_move *move)
+{
+    // no move at all, or every move loses the king: mate if the king can be
+    // taken now, stalemate if not; a king to take ends the game as well
+    if(!tiny_root_count || tiny_best_score <= -TINY_KING_VALUE / 2)
+    {
+        if(tiny_generate(tiny_side, tiny_moves[0]) == TINY_KING_TAKEN
+            || tiny_generate(1 - tiny_side, tiny_moves[0]) == TINY_KING_TAKEN)
+            return MOVE_NONE;
+        return MOVE_STALEMATE;
+    }
+
+    *move = tiny_moves[TINY_DEPTH][tiny_best_index];
+    tiny_make_move(move);
+
+    return MOVE_FOUND;
+}
+
+#if TINY_OVERLAY
+#pragma rodata-name(pop)
+#pragma code-name(pop)
+#endif
+
+struct chess_engine tiny_engine = {
+    "Tiny", TINY_OVERLAY,
+    tiny_init, tiny_set_position, tiny_make_move,
+    tiny_start_search, tiny_poll_search, tiny_get_best_move,
+    0, &tiny_stats,
+    0, 0
+};
+
+#endif
@@ -0,0 +1,474 @@
+//===================================================================================
+//
+//                                  GEOCHESS
+//
+// geoChess is a chess game for GEOS under the Commodore 64 and 128 computers
+//
+// Written by Scott Hutter
+// Nov 2023
+//
+// You are free to modify this code as desired, as long as original author credit
+// is mentioned for both the geos code and the included AI engines
+//===================================================================================
+
+//*********************************************************************************
+//
+// Texel tuner for the evaluation's piece weights and positional table.  Reads
+// positions labelled with the game's result, one per line:
+//
+//   <FEN> ... 1-0 | 0-1 | 1/2-1/2        e.g. EPD with c9 "1-0";
+//   <FEN> ... [1.0] | [0.5] | [0.0]
+//
+// and fits the parameters so that 1 / (1 + 10^(-K * eval / 400)) predicts the
+// result with the least squared error, starting from the tables in
+// geochess-ai.h.  The evaluation is linear in its parameters, so every
+// position is kept as the coefficient of each parameter (pieces of each type
+// and on each square, white's minus black's), one array per parameter: a pass
+// over the positions is then a run of multiply-adds over contiguous arrays
+// that the compiler vectorizes.  The file is memory-mapped; each worker parses
+// and then scores its own share of it.
+//
+// geochess-tune [-i iterations] [-r rate] [-k K] [-j workers] [-o out.c] file
+//
+//  -i      gradient steps, default 1000
+//  -r      step size in centipawns, default 1
+//  -k      scaling constant, fitted to the starting tables if not given
+//  -o      write the tables there instead of to stdout
+//
+// The output is starting_board[] and default_piece_weights[] in the layout of
+// geochess-ai.h, ready to replace them.
+//
+//********************************************************************************
+
+#include <fcntl.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "geochess-host.h"
+
+#define MATERIAL    5               // pawn, knight, bishop, rook, queen
+#define PARAMS      (MATERIAL + 64) // then the positional score of each square
+
+#define TILE        1024            // positions scored at a time
+#define MAXWORKERS  256
+
+// piece_weights[] index of each material parameter for white and black
+static const int material_index[2][MATERIAL] = { { 9, 12, 13, 14, 15 }, { 2, 4, 5, 6, 7 } };
+
+// the positions a worker parsed, parameter by parameter
+struct tune_worker {
+    const char *start, *end;        // its share of the file
+    int count, capacity, skipped;
+    signed char *coef[PARAMS];
+    float *result;                  // 1, 0.5 or 0 from white's point of view
+
+    // one pass
+    double loss;
+    double gradient[PARAMS];
+};
+
+struct tune_worker workers[MAXWORKERS];
+int worker_count;
+
+float params[PARAMS];
+double scale;                       // K * ln(10) / 400
+int want_gradient;
+
+// material parameter of a piece code, or -1 for kings
+int material_param(int piece)
+{
+    switch(piece & 7)
+    {
+        case 1: case 2: return 0;
+        case 4: return 1;
+        case 5: return 2;
+        case 6: return 3;
+        case 7: return 4;
+    }
+
+    return -1;
+}
+
+// the game's result on the line after the FEN, -1 if there is none
+float parse_result(const char *p, const char *end)
+{
+    for(; p < end; p++)
+    {
+        if(end - p >= 3 && !memcmp(p, "1-0", 3))
+            return 1.0f;
+        if(end - p >= 3 && !memcmp(p, "0-1", 3))
+            return 0.0f;
+        if(end - p >= 3 && !memcmp(p, "1/2", 3))
+            return 0.5f;
+        if(*p == '[' && end - p >= 2 && (p[1] == '0' || p[1] == '1'))
+            return (float)strtod(p + 1, 0);
+    }
+
+    return -1.0f;
+}
+
+// coefficients and result of one line, 0 on success
+int parse_line(const char *p, const char *end, signed char *coef, float *result)
+{
+    int sq = 0, piece, param;
+
+    memset(coef, 0, PARAMS);
+
+    while(p < end && *p == ' ')
+        p++;
+
+    for(; p < end && *p != ' '; p++)
+    {
+        if(*p == '/')
+            sq = (sq & 0x70) + 16;
+        else if(*p >= '1' && *p <= '8')
+            sq += *p - '0';
+        else
+        {
+            if(!(piece = piece_from_char(*p)) || (sq & 0x88))
+                return 1;
+
+            if((param = material_param(piece)) >= 0)
+                coef[param] += (piece & 8) ? 1 : -1;
+            coef[MATERIAL + PAWN_INDEX(sq)] = (piece & 8) ? 1 : -1;
+            sq++;
+        }
+    }
+
+    if(sq != 0x78)
+        return 1;
+
+    return (*result = parse_result(p, end)) < 0.0f;
+}
+
+void add_position(struct tune_worker *w, const signed char *coef, float result)
+{
+    int i;
+
+    if(w->count == w->capacity)
+    {
+        w->capacity = w->capacity ? w->capacity * 2 : 65536;
+        for(i = 0; i < PARAMS; i++)
+            w->coef[i] = realloc(w->coef[i], w->capacity);
+        w->result = realloc(w->result, w->capacity * sizeof(float));
+
+        if(!w->result || !w->coef[PARAMS - 1])
+        {
+            fprintf(stderr, "geochess-tune: out of memory\n");
+            exit(1);
+        }
+    }
+
+    for(i = 0; i < PARAMS; i++)
+        w->coef[i][w->count] = coef[i];
+    w->result[w->count++] = result;
+}
+
+// parse the lines that start in the worker's share of the file
+void *parse_worker(void *arg)
+{
+    struct tune_worker *w = arg;
+    const char *p = w->start, *line_end;
+    signed char coef[PARAMS];
+    float result;
+
+    for(; p < w->end; p = line_end + 1)
+    {
+        if(!(line_end = memchr(p, '\n', w->end - p)))
+            line_end = w->end;
+
+        if(!parse_line(p, line_end, coef, &result))
+            add_position(w, coef, result);
+        else if(line_end > p + 1)
+            w->skipped++;
+    }
+
+    return arg;
+}
+
+// squared error of the worker's positions and, if wanted, its gradient
+void *pass_worker(void *arg)
+{
+    struct tune_worker *w = arg;
+    float eval[TILE], delta[TILE];
+    float sigmoid, error, sum;
+    double loss = 0.0;
+    int base, n, i, j;
+
+    memset(w->gradient, 0, sizeof(w->gradient));
+
+    for(base = 0; base < w->count; base += TILE)
+    {
+        n = (w->count - base < TILE) ? w->count - base : TILE;
+
+        for(j = 0; j < n; j++)
+            eval[j] = 0.0f;
+
+        for(i = 0; i < PARAMS; i++)
+        {
+            const signed char *c = w->coef[i] + base;
+            const float p = params[i];
+
+            for(j = 0; j < n; j++)
+                eval[j] += p * c[j];
+        }
+
+        for(j = 0; j < n; j++)
+        {
+            sigmoid = 1.0f / (1.0f + expf((float)-scale * eval[j]));
+            error = sigmoid - w->result[base + j];
+            loss += error * error;
+            delta[j] = error * sigmoid * (1.0f - sigmoid);
+        }
+
+        if(!want_gradient)
+            continue;
+
+        for(i = 0; i < PARAMS; i++)
+        {
+            const signed char *c = w->coef[i] + base;
+
+            sum = 0.0f;
+            for(j = 0; j < n; j++)
+                sum += delta[j] * c[j];
+            w->gradient[i] += sum;
+        }
+    }
+
+    w->loss = loss;
+    return arg;
+}
+
+void run_workers(void *(*worker)(void *))
+{
+    pthread_t threads[MAXWORKERS];
+    int i;
+
+    for(i = 0; i < worker_count; i++)
+        pthread_create(&threads[i], 0, worker, &workers[i]);
+    for(i = 0; i < worker_count; i++)
+        pthread_join(threads[i], 0);
+}
+
+// mean squared error over all positions, gradient of it into gradient[]
+double pass(double *gradient, int positions)
+{
+    double loss = 0.0;
+    int i, k;
+
+    want_gradient = gradient != 0;
+    run_workers(pass_worker);
+
+    if(gradient)
+        memset(gradient, 0, PARAMS * sizeof(double));
+
+    for(k = 0; k < worker_count; k++)
+    {
+        loss += workers[k].loss;
+        if(gradient)
+            for(i = 0; i < PARAMS; i++)
+                gradient[i] += workers[k].gradient[i] * 2.0 * scale / positions;
+    }
+
+    return loss / positions;
+}
+
+// the K with the least error for the starting tables, by golden section
+double fit_k(int positions)
+{
+    const double ratio = 0.6180339887;
+    double a = 0.1, b = 3.0, c, d, fc, fd;
+
+    c = b - ratio * (b - a);
+    d = a + ratio * (b - a);
+    scale = c * M_LN10 / 400.0;
+    fc = pass(0, positions);
+    scale = d * M_LN10 / 400.0;
+    fd = pass(0, positions);
+
+    while(b - a > 0.001)
+    {
+        if(fc < fd)
+        {
+            b = d;
+            d = c;
+            fd = fc;
+            c = b - ratio * (b - a);
+            scale = c * M_LN10 / 400.0;
+            fc = pass(0, positions);
+        }
+        else
+        {
+            a = c;
+            c = d;
+            fc = fd;
+            d = a + ratio * (b - a);
+            scale = d * M_LN10 / 400.0;
+            fd = pass(0, positions);
+        }
+    }
+
+    return (a + b) / 2.0;
+}
+
+void write_tables(FILE *f, int positions, double k, double loss)
+{
+    int weights[16];
+    int r, c, i;
+
+    fprintf(f, "// geochess-tune: %d positions, K %.3f, error %.6f\n\n", positions, k, loss);
+
+    fprintf(f, "int starting_board[128] = {                 // 0x88 board + positional scores\n\n");
+    for(r = 0; r < 8; r++)
+    {
+        fprintf(f, "    ");
+        for(c = 0; c < 8; c++)
+            fprintf(f, "%2d, ", starting_board[r * 16 + c]);
+        fprintf(f, "   ");
+        for(c = 0; c < 8; c++)
+            fprintf(f, "%3d%s", (int)lrintf(params[MATERIAL + r * 8 + c]), (r == 7 && c == 7) ? "" : ", ");
+        fprintf(f, "\n");
+    }
+    fprintf(f, "\n};\n\n");
+
+    memcpy(weights, default_piece_weights, sizeof(weights));
+    for(i = 0; i < MATERIAL; i++)
+    {
+        weights[material_index[0][i]] = (int)lrintf(params[i]);
+        weights[material_index[1][i]] = -weights[material_index[0][i]];
+    }
+
+    fprintf(f, "int default_piece_weights[] = {");
+    for(i = 0; i < 16; i++)
+        fprintf(f, " %d%s", weights[i], i < 15 ? "," : " };\n");
+}
+
+void usage(void)
+{
+    fprintf(stderr, "usage: geochess-tune [-i iterations] [-r rate] [-k K] [-j workers] [-o out.c] file\n");
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    const double beta1 = 0.9, beta2 = 0.999;
+    double gradient[PARAMS], m[PARAMS], v[PARAMS];
+    double k = 0.0, rate = 1.0, loss, correction1 = 1.0, correction2 = 1.0;
+    int iterations = 1000, positions = 0, skipped = 0;
+    const char *out_name = 0;
+    const char *data;
+    struct stat st;
+    FILE *out = stdout;
+    int fd, opt, i, t;
+
+    worker_count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+
+    while((opt = getopt(argc, argv, "i:r:k:j:o:")) != -1)
+    {
+        switch(opt)
+        {
+            case 'i': iterations = atoi(optarg); break;
+            case 'r': rate = atof(optarg); break;
+            case 'k': k = atof(optarg); break;
+            case 'j': worker_count = atoi(optarg); break;
+            case 'o': out_name = optarg; break;
+            default: usage();
+        }
+    }
+
+    if(optind >= argc)
+        usage();
+
+    if(worker_count < 1)
+        worker_count = 1;
+    if(worker_count > MAXWORKERS)
+        worker_count = MAXWORKERS;
+
+    if((fd = open(argv[optind], O_RDONLY)) < 0 || fstat(fd, &st) || !st.st_size
+        || (data = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED)
+    {
+        fprintf(stderr, "geochess-tune: cannot read '%s'\n", argv[optind]);
+        return 1;
+    }
+    madvise((void *)data, st.st_size, MADV_SEQUENTIAL);
+
+    // equal shares, each starting after a line break
+    for(t = 0; t < worker_count; t++)
+    {
+        workers[t].start = data + st.st_size * t / worker_count;
+        workers[t].end = data + st.st_size * (t + 1) / worker_count;
+    }
+    for(t = 1; t < worker_count; t++)
+    {
+        while(workers[t].start < workers[t].end && workers[t].start[-1] != '\n')
+            workers[t].start++;
+        workers[t - 1].end = workers[t].start;
+    }
+
+    run_workers(parse_worker);
+    munmap((void *)data, st.st_size);
+    close(fd);
+
+    for(t = 0; t < worker_count; t++)
+    {
+        positions += workers[t].count;
+        skipped += workers[t].skipped;
+    }
+
+    if(!positions)
+    {
+        fprintf(stderr, "geochess-tune: no labelled positions in '%s'\n", argv[optind]);
+        return 1;
+    }
+
+    for(i = 0; i < MATERIAL; i++)
+        params[i] = default_piece_weights[material_index[0][i]];
+    for(i = 0; i < 64; i++)
+        params[MATERIAL + i] = starting_board[SQUARE(i >> 3, i & 7) + 8];
+
+    if(k <= 0.0)
+        k = fit_k(positions);
+    scale = k * M_LN10 / 400.0;
+
+    fprintf(stderr, "%d positions (%d lines skipped) on %d workers, K %.3f, error %.6f\n",
+        positions, skipped, worker_count, k, pass(0, positions));
+
+    // Adam: per-parameter steps scaled by the gradient's running moments
+    memset(m, 0, sizeof(m));
+    memset(v, 0, sizeof(v));
+
+    for(t = 1; t <= iterations; t++)
+    {
+        loss = pass(gradient, positions);
+        correction1 *= beta1;
+        correction2 *= beta2;
+
+        for(i = 0; i < PARAMS; i++)
+        {
+            m[i] = beta1 * m[i] + (1.0 - beta1) * gradient[i];
+            v[i] = beta2 * v[i] + (1.0 - beta2) * gradient[i] * gradient[i];
+            params[i] -= rate * (m[i] / (1.0 - correction1)) / (sqrt(v[i] / (1.0 - correction2)) + 1e-12);
+        }
+
+        if(t % 100 == 0 || t == iterations)
+            fprintf(stderr, "iteration %d: error %.6f\n", t, loss);
+    }
+
+    loss = pass(0, positions);
+
+    if(out_name && !(out = fopen(out_name, "w")))
+    {
+        fprintf(stderr, "geochess-tune: cannot write '%s'\n", out_name);
+        return 1;
+    }
+
+    write_tables(out, positions, k, loss);
+
+    if(out != stdout)
+        fclose(out);
+
+    return 0;
+}
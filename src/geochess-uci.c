@@ -0,0 +1,305 @@
+//===================================================================================
+//
+//                                  GEOCHESS
+//
+// geoChess is a chess game for GEOS under the Commodore 64 and 128 computers
+//
+// Written by Scott Hutter
+// Nov 2023
+//
+// You are free to modify this code as desired, as long as original author credit
+// is mentioned for both the geos code and the included AI engines
+//===================================================================================
+
+//*********************************************************************************
+//
+// UCI front end for the geoChess engine, built natively on the host with
+// build-host.sh.  It drives the same SearchPosition() the GEOS build uses, so
+// engine changes can be measured in a tournament manager before they are
+// taken to the 6502.
+//
+//********************************************************************************
+
+#include <stdlib.h>
+#include <sys/select.h>
+#include <unistd.h>
+#include "geochess-host.h"
+
+#define INPUTBUFFERSIZE 8192
+#define DEFAULT_HASH    16          // MB
+
+struct host_engine uci;
+int quit_requested = 0;
+
+// commands that arrive while searching are run once the search is over
+#define MAXPENDING  16
+char pending[MAXPENDING][INPUTBUFFERSIZE];
+int pending_count = 0;
+
+void handle_command(char *line);
+
+// a line is waiting on stdin
+int input_waiting(void)
+{
+    fd_set readfds;
+    struct timeval tv;
+
+    FD_ZERO(&readfds);
+    FD_SET(0, &readfds);
+    tv.tv_sec = 0;
+    tv.tv_usec = 0;
+
+    return select(1, &readfds, 0, 0, &tv) > 0;
+}
+
+// polled from the search so "stop" and "isready" are answered while thinking
+void uci_poll(struct host_engine *h)
+{
+    char line[INPUTBUFFERSIZE];
+
+    if(input_waiting() && fgets(line, sizeof(line), stdin))
+    {
+        if(!strncmp(line, "stop", 4))
+            h->stop_requested = 1;
+        else if(!strncmp(line, "quit", 4))
+            h->stop_requested = quit_requested = 1;
+        else if(!strncmp(line, "isready", 7))
+            printf("readyok\n");
+        else if(pending_count < MAXPENDING)
+            strcpy(pending[pending_count++], line);
+    }
+}
+
+// one info line, "multipv n" with it when there are several
+void print_line(struct host_engine *h, int multipv, int score, const struct move *line, unsigned char length)
+{
+    char pv[MAX_PLY * 6];
+    unsigned long nodes = h->engine.stats.nodes;
+    unsigned long elapsed = ENGINE_TICKS() - h->engine.stats.start;
+
+    pv_to_text(h, line, length, pv);
+
+    printf("info depth %d", h->current_depth);
+    if(multipv)
+        printf(" multipv %d", multipv);
+
+    // mates in moves, from their distance in plies
+    printf(" score ");
+    if(score > MATE_BOUND)
+        printf("mate %d", (MATE - score + 1) / 2);
+    else if(score < -MATE_BOUND)
+        printf("mate %d", -(MATE + score) / 2);
+    else
+        printf("cp %d", score);
+
+    printf(" nodes %lu nps %lu time %lu", nodes, elapsed ? nodes * 1000 / elapsed : 0, elapsed);
+
+    if(pv[0])
+        printf(" pv %s", pv);
+    printf("\n");
+}
+
+// with MultiPV above 1 one line per root move kept, best first
+void print_info(struct host_engine *h, int score)
+{
+    struct engine *e = &h->engine;
+    int i;
+
+    if(e->multipv > 1 && e->root_count)
+    {
+        for(i = 0; i < e->root_count; i++)
+            print_line(h, i + 1, e->root_moves[i].score, e->root_moves[i].pv, e->root_moves[i].pv_length);
+    }
+    else
+        print_line(h, 0, score, e->pv[0], e->pv_length[0]);
+
+    fflush(stdout);
+}
+
+void go(void)
+{
+    struct move best;
+    char move[6];
+
+    uci.poll = uci_poll;
+    uci.info = print_info;
+    search_best(&uci, &best);
+
+    // "go infinite" must not answer before "stop"
+    while(uci.limits.infinite && !uci.stop_requested && !quit_requested)
+    {
+        char line[INPUTBUFFERSIZE];
+
+        if(!fgets(line, sizeof(line), stdin))
+            break;
+        if(!strncmp(line, "stop", 4))
+            uci.stop_requested = 1;
+        else
+            handle_command(line);
+    }
+
+    if(best.src == NO_MOVE)
+        printf("bestmove 0000\n");
+    else
+    {
+        move_to_text(&uci, best, move);
+        printf("bestmove %s\n", move);
+    }
+    fflush(stdout);
+}
+
+// go perft <depth>: leaf count of the current position, to compare move
+// generators (the host build's bitboards against the GEOS build's 0x88)
+void perft(int depth)
+{
+    unsigned long start = host_ticks(), nodes, elapsed;
+
+    if(depth >= MAX_PLY)
+        depth = MAX_PLY - 1;
+    nodes = Perft(&uci.engine, uci.engine.side, depth);
+    elapsed = host_ticks() - start;
+
+    printf("info depth %d nodes %lu time %lu nps %lu\n", depth, nodes, elapsed,
+        elapsed ? nodes * 1000UL / elapsed : 0);
+    printf("Nodes searched: %lu\n", nodes);
+}
+
+void parse_go(char *args)
+{
+    struct search_limits *limits = &uci.limits;
+    char *token;
+
+    memset(limits, 0, sizeof(*limits));
+
+    for(token = strtok(args, " \t\r\n"); token; token = strtok(0, " \t\r\n"))
+    {
+        if(!strcmp(token, "perft") && (token = strtok(0, " \t\r\n")))
+        {
+            perft(atoi(token));
+            return;
+        }
+        else if(!strcmp(token, "infinite"))
+            limits->infinite = 1;
+        else if(!strcmp(token, "depth") && (token = strtok(0, " \t\r\n")))
+            limits->depth = atoi(token);
+        else if(!strcmp(token, "nodes") && (token = strtok(0, " \t\r\n")))
+            limits->nodes = strtoul(token, 0, 10);
+        else if(!strcmp(token, "movetime") && (token = strtok(0, " \t\r\n")))
+            limits->movetime = strtoul(token, 0, 10);
+        else if(!strcmp(token, "wtime") && (token = strtok(0, " \t\r\n")))
+            limits->wtime = strtoul(token, 0, 10);
+        else if(!strcmp(token, "btime") && (token = strtok(0, " \t\r\n")))
+            limits->btime = strtoul(token, 0, 10);
+        else if(!strcmp(token, "winc") && (token = strtok(0, " \t\r\n")))
+            limits->winc = strtoul(token, 0, 10);
+        else if(!strcmp(token, "binc") && (token = strtok(0, " \t\r\n")))
+            limits->binc = strtoul(token, 0, 10);
+        else if(!strcmp(token, "movestogo") && (token = strtok(0, " \t\r\n")))
+            limits->movestogo = atoi(token);
+    }
+
+    go();
+}
+
+// setoption name <Hash | Threads | MultiPV> value <n>
+void parse_setoption(char *args)
+{
+    char *name = strstr(args, "name");
+    char *value = strstr(args, "value");
+
+    if(!name || !value)
+        return;
+
+    name += 4;
+    name += strspn(name, " ");
+    value += 5;
+
+    if(!strncmp(name, "Hash", 4))
+        host_set_hash(&uci, strtoul(value, 0, 10));
+    else if(!strncmp(name, "Threads", 7))
+        uci.threads = atoi(value) < 1 ? 1 : atoi(value);
+    else if(!strncmp(name, "MultiPV", 7))
+        uci.engine.multipv = atoi(value) < 1 ? 1 : (atoi(value) > MULTIPV_MAX ? MULTIPV_MAX : atoi(value));
+}
+
+// position [startpos | fen <fen>] [moves <move> ...]
+void parse_position(char *args)
+{
+    char *moves = strstr(args, "moves");
+    char *token;
+
+    if(moves)
+        *moves = 0;
+
+    while(*args == ' ')
+        args++;
+
+    if(!strncmp(args, "fen", 3))
+        set_fen(&uci, args + 3 + strspn(args + 3, " "));
+    else
+        set_fen(&uci, STARTPOS);
+
+    if(!moves)
+        return;
+
+    for(token = strtok(moves + 5, " \t\r\n"); token; token = strtok(0, " \t\r\n"))
+        make_text_move(&uci, token);
+}
+
+void handle_command(char *line)
+{
+    line[strcspn(line, "\r\n")] = 0;
+
+    if(!strcmp(line, "uci"))
+    {
+        printf("id name GeoChess BMCP\n");
+        printf("id author Scott Hutter, Maksim Korzh\n");
+        printf("option name Hash type spin default %d min 0 max 4096\n", DEFAULT_HASH);
+        printf("option name Threads type spin default 1 min 1 max %d\n", MAX_THREADS);
+        printf("option name MultiPV type spin default 1 min 1 max %d\n", MULTIPV_MAX);
+        printf("uciok\n");
+    }
+    else if(!strcmp(line, "isready"))
+        printf("readyok\n");
+    else if(!strcmp(line, "ucinewgame"))
+    {
+        set_fen(&uci, STARTPOS);
+        host_clear_hash(&uci);
+    }
+    else if(!strncmp(line, "setoption", 9))
+        parse_setoption(line + 9);
+    else if(!strncmp(line, "position", 8))
+        parse_position(line + 8);
+    else if(!strncmp(line, "go", 2))
+        parse_go(line + 2);
+    else if(!strcmp(line, "d"))
+        print_board(&uci, stdout);
+    else if(!strcmp(line, "quit"))
+        quit_requested = 1;
+
+    fflush(stdout);
+}
+
+int main(void)
+{
+    char line[INPUTBUFFERSIZE];
+    int i;
+
+    host_init(&uci);
+    host_set_hash(&uci, DEFAULT_HASH);
+    set_fen(&uci, STARTPOS);
+
+    while(!quit_requested && fgets(line, sizeof(line), stdin))
+    {
+        handle_command(line);
+
+        for(i = 0; i < pending_count && !quit_requested; i++)
+        {
+            strcpy(line, pending[i]);
+            handle_command(line);
+        }
+        pending_count = 0;
+    }
+
+    return 0;
+}
@@ -15,14 +15,26 @@
 //#include "geochess-res.h"
 #include "geochess.h"
 #include "geochess-ai.h"
+#include "geochess-mate.h"
+#include "geochess-tiny.h"
+#include "geochess-probe.h"
+#include <stdlib.h>
 #include <string.h>
 
-void main(void)
+// engines to choose from in the menu
+struct chess_engine *engines[] = { &bmcp_engine, &tiny_engine };
+#define ENGINE_COUNT    (sizeof(engines) / sizeof(engines[0]))
+
+unsigned char engine_choice = DEFAULT_ENGINE;
+struct chess_engine *active_engine;
+
+void main(int argc, char *argv[])
 {
     char msg[16];
     const char* versionString = TOSTRING(VERSION);
 
 	osType = get_ostype();
+    PROBE_INIT();
     
     strcpy(msg, "GeoChess v");
     strcat(msg, versionString);
@@ -56,12 +68,29 @@ void main(void)
 
     memset(gboard, 0, sizeof(gboard));
 
+    // show BMCP's counters while it thinks, other engines are polled
+    engine.search_progress = UpdateStats;
+    active_engine = engines[engine_choice];
+
+    // the overlays are records of our own file
+    strcpy(app_name, argv[0]);
+
+    LoadOverlay(OVERLAY_SETUP);
+    PROBE_BEGIN(PHASE_DISK);
     LoadFont();
+    PROBE_END(PHASE_DISK);
     InitScreen();
+    LoadOverlay(OVERLAY_LOG);
+    PROBE_BEGIN(PHASE_DISK);
+    LoadLearning();
+    PROBE_END(PHASE_DISK);
     NewGame();
     MainLoop();
 }
 
+#pragma code-name(push, "OVERLAY2")
+#pragma rodata-name(push, "OVERLAY2")
+
 void LoadFont(void)
 {
     char fname[15] = "geochessfont40";
@@ -82,16 +111,91 @@ void LoadFont(void)
 	PointRecord(16);
 	ReadRecord(fontbuffer, FONTBUFFERSIZE);
 	CloseRecordFile();
+
+    // the 80 column board bypasses PutChar, using images built from this font
+    vdc_render = 0;
+    if (ISGEOS128)
+    {
+        if(C128_80_COL_MODE) {
+            VdcBuildSquares();
+            vdc_render = 1;
+        }
+    }
+}
+
+#pragma rodata-name(pop)
+#pragma code-name(pop)
+
+unsigned long ReadTodTenths(void)
+{
+    unsigned char hr, min, sec, tenths;
+
+    // reading the hours latches the clock until the tenths are read
+    asm("sei");
+    hr = CIA1_TODHR;
+    min = CIA1_TODMIN;
+    sec = CIA1_TODSEC;
+    tenths = CIA1_TOD10THS;
+    asm("cli");
+
+    // registers are BCD, hours are 1-12 with bit 7 as the PM flag
+    min = (min >> 4) * 10 + (min & 0x0f);
+    sec = (sec >> 4) * 10 + (sec & 0x0f);
+    tenths &= 0x0f;
+
+    if(hr & 0x80)
+        hr = ((hr & 0x10) ? 10 : 0) + (hr & 0x0f) + 12;
+    else
+        hr = ((hr & 0x10) ? 10 : 0) + (hr & 0x0f);
+
+    if(hr == 12 || hr == 24)
+        hr -= 12;
+
+    return (((unsigned long)hr * 60 + min) * 60 + sec) * 10 + tenths;
 }
 
+// append an unsigned decimal number to a string
+void AppendNumber(char *s, unsigned long n)
+{
+    char digits[11];
+    unsigned char i = 10;
+
+    digits[10] = 0;
+    do
+    {
+        digits[--i] = '0' + (char)(n % 10);
+        n /= 10;
+    }
+    while(n);
+
+    strcat(s, &digits[i]);
+}
+
+// append a tick count as seconds with one decimal
+void AppendTenths(char *s, unsigned long tenths)
+{
+    char frac[2];
+
+    AppendNumber(s, tenths / 10);
+    frac[0] = '0' + (char)(tenths % 10);
+    frac[1] = 0;
+    strcat(s, ".");
+    strcat(s, frac);
+}
+
+// square is in 320 pixel units and is left as it is
 void DrawRect(unsigned char pattern, struct window *square) 
 {
+    struct window scaled;
+
     SetPattern(pattern);
  
-    square->left = square->left  * sc_width;
-    square->right = square->right * sc_width;
+    scaled.top = square->top;
+    scaled.bot = square->bot;
+    scaled.left = square->left  * sc_width;
+    scaled.right = square->right * sc_width;
  
-    InitDrawWindow(square);
+    InitDrawWindow(&scaled);
     Rectangle();
 }
 
@@ -102,9 +206,63 @@ void DrawStdRect(unsigned char pattern, struct window *square)
     Rectangle();
 }
 
+// Batched drawing.  Between BeginBackDraw() and EndBackDraw() GEOS draws
+// into the background buffer only and MarkDirty() notes each changed area
+// (screen units).  The outermost EndBackDraw() then copies those areas to
+// the screen together, so a multi-square update appears at once.  Batches
+// nest, letting a caller join several updates into one.
+void BeginBackDraw(void)
+{
+    if(!back_draw_depth++)
+    {
+        dirty_count = 0;
+        dispBufferOn = ST_WR_BACK;
+    }
+}
+
+void MarkDirty(unsigned char top, unsigned char bot, unsigned int left, unsigned int right)
+{
+    struct window *area;
+
+    if(dirty_count < DIRTY_MAX)
+    {
+        area = &dirty[dirty_count++];
+        area->top = top;
+        area->bot = bot;
+        area->left = left;
+        area->right = right;
+        return;
+    }
+
+    // out of slots: grow the last area to cover this one too
+    area = &dirty[DIRTY_MAX - 1];
+    if(top < area->top) area->top = top;
+    if(bot > area->bot) area->bot = bot;
+    if(left < area->left) area->left = left;
+    if(right > area->right) area->right = right;
+}
+
+void EndBackDraw(void)
+{
+    unsigned char i;
+
+    if(--back_draw_depth)
+        return;
+
+    dispBufferOn = ST_WR_FORE | ST_WR_BACK;
+
+    for(i = 0; i < dirty_count; i++)
+    {
+        InitDrawWindow(&dirty[i]);
+        RecoverRectangle();
+    }
+
+    dirty_count = 0;
+}
+
 unsigned char GetPieceChar(unsigned char row, unsigned char col) 
 {
-    unsigned char piece;
+    unsigned char piece = EMPTY;
 
     switch(gboard[row][col][0])
     {
@@ -149,6 +307,138 @@ unsigned char GetPieceChar(unsigned char row, unsigned char col)
     return piece;
 }
 
+// the host stand-in emulates the VDC behind these two
+#ifndef GEOS_HOST
+unsigned char VdcRead(unsigned char reg)
+{
+    VDC_ADDR = reg;
+    while(!(VDC_ADDR & 0x80));
+    return VDC_DATA;
+}
+
+void VdcWrite(unsigned char reg, unsigned char value)
+{
+    VDC_ADDR = reg;
+    while(!(VDC_ADDR & 0x80));
+    VDC_DATA = value;
+}
+#endif
+
+void VdcSetAddress(unsigned int address)
+{
+    VdcWrite(VDC_UPDATE_HI, address >> 8);
+    VdcWrite(VDC_UPDATE_LO, address & 0xff);
+}
+
+#pragma code-name(push, "OVERLAY2")
+#pragma rodata-name(push, "OVERLAY2")
+
+// Cut every piece glyph of the loaded 80 column font into a square image,
+// already shifted to the squares' bit position.  Lines above and below the
+// glyph get the square colour.
+void VdcBuildSquares(void)
+{
+    // the header's words are 16 bits, short keeps them so on the host too
+    unsigned char baseline = fontbuffer[0];
+    unsigned int row_bytes = *(unsigned short *)(fontbuffer + 1);
+    unsigned char height = fontbuffer[3];
+    unsigned short *index = (unsigned short *)(fontbuffer + *(unsigned short *)(fontbuffer + 4));
+    unsigned char *bits = (unsigned char *)fontbuffer + *(unsigned short *)(fontbuffer + 6);
+    unsigned char glyph, line, top, shift, bg, j;
+    unsigned int start;
+    unsigned char *src;
+    unsigned char *dst;
+
+    // glyph rows start this many lines into the square (PutChar baseline 50 on row 0)
+    top = 50 - baseline - (BOARD_TOP + 1);
+
+    for(glyph = 0; glyph < 24; glyph++)
+    {
+        // A-F and M-R sit on white squares, G-L and S-X on black
+        bg = (glyph < 6 || (glyph >= 12 && glyph < 18)) ? 0x00 : 0xff;
+
+        // the image's first byte starts 6 pixels before the glyph
+        start = index['A' + glyph - 32] - 6;
+        shift = start & 7;
+
+        for(line = 0; line <= SQUARE_HEIGHT; line++)
+        {
+            dst = vdc_squares[glyph][line];
+
+            if(line < top || line >= top + height)
+                memset(dst, bg, VDC_SQUARE_BYTES);
+            else
+            {
+                src = bits + (line - top) * row_bytes + (start >> 3);
+                for(j = 0; j < VDC_SQUARE_BYTES; j++)
+                    dst[j] = (src[j] << shift) | (src[j + 1] >> (8 - shift));
+            }
+
+            dst[0] &= VDC_FIRST_MASK;
+            dst[VDC_SQUARE_BYTES - 1] &= VDC_LAST_MASK;
+        }
+    }
+}
+
+#pragma rodata-name(pop)
+#pragma code-name(pop)
+
+// Draw one 80 column square with its piece straight into VDC memory.  Empty
+// squares are block fills; the bytes shared with the grid lines are merged.
+// The square is then imprinted into the background buffer.  The caller hides
+// the mouse first.
+void VdcDrawSquare(unsigned char row, unsigned char col)
+{
+    unsigned char piece = GetPieceChar(row, col);
+    unsigned char fill = (gboard[row][col][1] == WHT) ? 0x00 : 0xff;
+    unsigned int address = VDC_SQUARE_ADDR(row, col);
+    unsigned char *image;
+    unsigned char line, old, j;
+
+    asm("php");
+    asm("sei");
+
+    // word count writes fill rather than copy
+    VdcWrite(VDC_CONTROL, VdcRead(VDC_CONTROL) & 0x7f);
+
+    for(line = 0; line <= SQUARE_HEIGHT; line++, address += VDC_LINE_BYTES)
+    {
+        VdcSetAddress(address);
+        old = VdcRead(VDC_DATA_REG) & ~VDC_FIRST_MASK;
+        VdcSetAddress(address);
+
+        if(piece == EMPTY)
+        {
+            VdcWrite(VDC_DATA_REG, old | (fill & VDC_FIRST_MASK));
+            VdcWrite(VDC_DATA_REG, fill);
+            VdcWrite(VDC_WORD_COUNT, VDC_SQUARE_BYTES - 3);
+            old = VdcRead(VDC_DATA_REG) & ~VDC_LAST_MASK;
+            VdcSetAddress(address + VDC_SQUARE_BYTES - 1);
+            VdcWrite(VDC_DATA_REG, old | (fill & VDC_LAST_MASK));
+        }
+        else
+        {
+            image = vdc_squares[piece - 'A'][line];
+
+            VdcWrite(VDC_DATA_REG, old | image[0]);
+            for(j = 1; j < VDC_SQUARE_BYTES - 1; j++)
+                VdcWrite(VDC_DATA_REG, image[j]);
+            old = VdcRead(VDC_DATA_REG) & ~VDC_LAST_MASK;
+            VdcSetAddress(address + VDC_SQUARE_BYTES - 1);
+            VdcWrite(VDC_DATA_REG, old | image[j]);
+        }
+    }
+
+    asm("plp");
+
+    // menus and dialogs restore the screen from the background buffer
+    InitDrawWindow(&vboard[row][col]);
+    ImprintRectangle();
+}
+
+#pragma code-name(push, "OVERLAY2")
+#pragma rodata-name(push, "OVERLAY2")
+
 void InitScreen(void) {
 
     char *s = "  GeoChess  ";
@@ -205,6 +495,11 @@ void InitBoard(unsigned char initalPosition)
     unsigned char piece;          
     struct window rect;
 
+    BeginBackDraw();
+
+    // board, grid and notation letters
+    MarkDirty(BOARD_TOP, 187, 10 * sc_width, (BOARD_LEFT + 161) * sc_width - 1);
+
     // clear the area
     rect.top = BOARD_TOP;
     rect.left = BOARD_LEFT;
@@ -235,8 +530,8 @@ void InitBoard(unsigned char initalPosition)
         for (j = 0; j < 8; j++) {
             vboard[i][j].top = top_offset;
             vboard[i][j].bot = top_offset + SQUARE_HEIGHT;
-            vboard[i][j].left = left_offset;
-            vboard[i][j].right = left_offset + SQUARE_WIDTH;
+            vboard[i][j].left = left_offset * sc_width;
+            vboard[i][j].right = (left_offset + SQUARE_WIDTH) * sc_width;
 
             left_offset += SQUARE_WIDTH + 2;
         }
@@ -251,7 +546,8 @@ void InitBoard(unsigned char initalPosition)
     {
         for(j=0;j<8;j++)
         {   
-            DrawRect(toggle, &vboard[i][j]);
+            if(!vdc_render)
+                DrawStdRect(toggle, &vboard[i][j]);
             gboard[i][j][1] = (toggle == 0 ? WHT : BLK);
             toggle = (toggle == 1 ? 0 : 1);
         }
@@ -317,6 +613,17 @@ void InitBoard(unsigned char initalPosition)
         gboard[7][7][0] = WHT_ROOK;
     }
 
+    if(vdc_render)
+    {
+        // squares and pieces in one pass
+        TEMP_HIDE_MOUSE
+        for(i=0;i<8;i++)
+            for(j=0;j<8;j++)
+                VdcDrawSquare(i, j);
+        EndBackDraw();
+        return;
+    }
+
     // switch character sets
     LoadCharSet ((struct fontdesc *)(fontbuffer));
 
@@ -331,12 +638,16 @@ void InitBoard(unsigned char initalPosition)
         }
     }
 
+    EndBackDraw();
 }
 
 void InitMovePanel(void) 
 {
     struct window rect;
 
+    BeginBackDraw();
+    MarkDirty(33, 178, 207 * sc_width, 314 * sc_width - 1);
+
     // clear the area
     rect.top = 44;
     rect.left = 208;
@@ -369,18 +680,49 @@ void InitMovePanel(void)
     UseSystemFont();
     PutString("  move log  ", 40, 215 * sc_width);
 
+    EndBackDraw();
+}
+
+#pragma rodata-name(pop)
+#pragma code-name(pop)
+
+// a game is over: keep what the engines learned in it
+void KeepLearning(void)
+{
+    if(!learn_changed)
+        return;
+
+    LoadOverlay(OVERLAY_LOG);
+    SaveLearning();
 }
 
 void NewGame(void)
 {
+    KeepLearning();
+
     notation_row_count = 0;
     notation_text_position = 55;
+    move_number = 0;
+    castle_rights = CASTLE_KINGSIDE | CASTLE_QUEENSIDE;
+    ep_col = 255;
+
+    // each game starts a new record in the search log
+    log_length = 0;
+    log_record = 255;
 
+    LoadOverlay(OVERLAY_SETUP);
+    PROBE_BEGIN(PHASE_DRAW);
     InitBoard(0);
+    PROBE_END(PHASE_DRAW);
     InitMovePanel();
-    engine_init();
+    LoadOverlay(active_engine->overlay);
+    active_engine->init();
     UpdateStatus("Your move.");
     gameState = INPROGRESS;
+    HideHints();
+    if (analysis_enabled)
+        ShowHints();
+    PROBE_NEXT();
     DoMenu((struct menu *)&mainMenu);
 }
 
@@ -408,6 +750,8 @@ void UpdateNotation(unsigned char player, unsigned char src_row, unsigned char s
 
     current_move[4] = 0;
 
+    BeginBackDraw();
+
     if(notation_row_count == 11)
     {
         // clear the page
@@ -419,7 +763,10 @@ void UpdateNotation(unsigned char player, unsigned char src_row, unsigned char s
         notation_row_count = 0;
         notation_text_position = 55;
         VerticalLine(255, 45, 174, 257 * sc_width);
+        MarkDirty(44, 175, 208 * sc_width, 311 * sc_width - 1);
     }
+    else
+        MarkDirty(notation_text_position - 7, notation_text_position + 2, 215 * sc_width, 311 * sc_width - 1);
 
     UseSystemFont();
     
@@ -432,16 +779,246 @@ void UpdateNotation(unsigned char player, unsigned char src_row, unsigned char s
     notation_text_position += 11;
     notation_row_count++;
 
-    
+    EndBackDraw();
 }
 
 void UpdateStatus(char *message)
 {
+    BeginBackDraw();
+    MarkDirty(181, 190, 215 * sc_width, 320 * sc_width - 1);
     UseSystemFont();
     PutString("                    ", 188, 215 * sc_width);
     PutString(message, 188, 215 * sc_width);
+    EndBackDraw();
+}
+
+void UpdateStats(void)
+{
+    char line[40];                  // three counters of up to ten digits
+    unsigned long elapsed;
+    struct search_stats *stats = active_engine->stats;
+
+    if(!stats)
+        return;
+
+    // called from inside the search as well as after it
+    elapsed = stats->elapsed;
+    if(!elapsed)
+        elapsed = ENGINE_TICKS() - stats->start;
+
+    // one line has room for three numbers: while the search runs, every
+    // other second shows evaluations, cutoffs and hash hits instead
+    line[0] = 0;
+    if(!stats->elapsed && (elapsed / ENGINE_TICKS_PER_SEC) & 1)
+    {
+        AppendNumber(line, stats->evals);
+        strcat(line, "e ");
+        AppendNumber(line, stats->cutoffs);
+        strcat(line, "c ");
+        AppendNumber(line, stats->hash_hits);
+        strcat(line, "h");
+    }
+    else
+    {
+        AppendNumber(line, stats->nodes);
+        strcat(line, "n ");
+        AppendNumber(line, search_first_cutoff_rate(stats));
+        strcat(line, "% ");
+        AppendTenths(line, elapsed);
+        strcat(line, "s");
+    }
+
+    ShowStatsLine(line);
+}
+
+// the line under the status
+void ShowStatsLine(char *line)
+{
+    BeginBackDraw();
+    MarkDirty(190, 199, 215 * sc_width, 320 * sc_width - 1);
+    UseSystemFont();
+    PutString("                    ", 197, 215 * sc_width);
+    PutString(line, 197, 215 * sc_width);
+    EndBackDraw();
+}
+
+#pragma code-name(push, "OVERLAY3")
+#pragma rodata-name(push, "OVERLAY3")
+
+// an empty VLIR data file, records are added by the caller
+void CreateDataFile(char *name, char *class_name)
+{
+    memset(&log_header, 0, sizeof(log_header));
+
+    // SaveFile takes the file name from the first word of the header
+    *(char **)&log_header = name;
+
+    log_header.icon_desc[0] = 3;
+    log_header.icon_desc[1] = 21;
+    log_header.icon_desc[2] = 63 | 0x80;
+    memcpy(log_header.icon_pic, log_icon, sizeof(log_icon));
+    log_header.dostype = USR | 0x80;
+    log_header.type = APPL_DATA;
+    log_header.structure = VLIR;
+    strcpy(log_header.class_name, class_name);
+
+    SaveFile(0, &log_header);
+}
+
+void CreateSearchLog(void)
+{
+    CreateDataFile(log_name, "GeoChess log V1.0");
+}
+
+// read each engine's learning table from its record, if the file exists
+void LoadLearning(void)
+{
+    unsigned char i;
+
+    if(OpenRecordFile(learn_name) != 0)
+        return;
+
+    for(i = 0; i < ENGINE_COUNT; i++)
+    {
+        if(engines[i]->learn && PointRecord(i) == 0)
+            ReadRecord(engines[i]->learn, engines[i]->learn_size);
+    }
+
+    CloseRecordFile();
+}
+
+// write the tables back, creating the file with one record per engine
+void SaveLearning(void)
+{
+    unsigned char i;
+
+    if(OpenRecordFile(learn_name) != 0)
+    {
+        CreateDataFile(learn_name, "GeoChess learn V1.0");
+        if(OpenRecordFile(learn_name) != 0)
+            return;
+
+        for(i = 0; i < ENGINE_COUNT; i++)
+            AppendRecord();
+    }
+
+    for(i = 0; i < ENGINE_COUNT; i++)
+    {
+        if(engines[i]->learn && PointRecord(i) == 0)
+            WriteRecord(engines[i]->learn, engines[i]->learn_size);
+    }
+
+    CloseRecordFile();
+    learn_changed = 0;
+}
+
+// square name of the UI's board, e.g. "e2"
+void AppendSquare(char *line, unsigned char sq)
+{
+    sq = MOVE_SQUARE(sq);
+    strcat(line, gbnotation[SQUARE_ROW(sq)][SQUARE_COL(sq)]);
+}
+
+void WriteSearchLog(struct chess_move *user, struct chess_move *reply)
+{
+    // worst case: move and squares 17, engine name 8, counters at ten
+    // digits each 87, a pv of 8 moves 43, the return and the terminator 2
+    char line[160];
+    unsigned int len;
+    unsigned char i, count;
+    struct chess_move pv[8];
+    struct search_stats *stats = active_engine->stats;
+
+    // move, moves played (no reply: mate), then the engine and its counters
+    line[0] = 0;
+    AppendNumber(line, ++move_number);
+    strcat(line, ". ");
+    AppendSquare(line, user->src);
+    AppendSquare(line, user->dst);
+    strcat(line, " ");
+    if(reply)
+    {
+        AppendSquare(line, reply->src);
+        AppendSquare(line, reply->dst);
+    }
+    else
+        strcat(line, "mate");
+    strcat(line, " ");
+    strncat(line, active_engine->name, 8);
+
+    if(stats)
+    {
+        strcat(line, " d");
+        AppendNumber(line, stats->depth);
+        strcat(line, " n");
+        AppendNumber(line, stats->nodes);
+        strcat(line, " e");
+        AppendNumber(line, stats->evals);
+        strcat(line, " c");
+        AppendNumber(line, stats->cutoffs);
+        strcat(line, " f");
+        AppendNumber(line, search_first_cutoff_rate(stats));
+        strcat(line, "% h");
+        AppendNumber(line, stats->hash_hits);
+        strcat(line, " t");
+        AppendTenths(line, stats->elapsed);
+        strcat(line, " nps");
+        AppendNumber(line, search_nps(stats));
+    }
+
+    if(active_engine->get_pv)
+    {
+        strcat(line, " pv");
+
+        count = active_engine->get_pv(pv, 8);
+        for(i = 0; i < count; i++)
+        {
+            strcat(line, " ");
+            AppendSquare(line, pv[i].src);
+            AppendSquare(line, pv[i].dst);
+        }
+    }
+    strcat(line, "\r");
+
+    // a full record is left behind and the game continues in a new one
+    len = strlen(line);
+    if(log_length + len > LOGBUFFERSIZE)
+    {
+        log_length = 0;
+        log_record = 255;
+    }
+
+    memcpy(&logbuffer[log_length], line, len);
+    log_length += len;
+
+    if(OpenRecordFile(log_name) != 0)
+    {
+        log_enabled = 0;
+        return;
+    }
+
+    if(log_record == 255)
+    {
+        // find the last record and append after it
+        log_record = 0;
+        while(PointRecord(log_record) == 0)
+            log_record++;
+
+        if(log_record > 0)
+            PointRecord(log_record - 1);
+
+        AppendRecord();
+    }
+    else
+        PointRecord(log_record);
+
+    WriteRecord(logbuffer, log_length);
+    CloseRecordFile();
 }
 
+#pragma rodata-name(pop)
+#pragma code-name(pop)
+
 unsigned char isKingInCheck(unsigned char kingRow, unsigned char kingCol)
 {
     unsigned char i;
@@ -654,10 +1231,25 @@ unsigned char isMoveIsValid(char src_row, char src_col, char dest_row, char dest
         switch (moving_piece)
         {
             case WHT_KING:
-                if ( ((src_row > dest_row) ? (src_row - dest_row) : (dest_row - src_row)) > 1)
-                    invalidmove++;
-                if ( ((src_col > dest_col) ? (src_col - dest_col) : (dest_col - src_col)) > 1)
-                    invalidmove++;
+                if (src_row == 7 && src_col == 4 && dest_row == 7 && (dest_col == 6 || dest_col == 2))
+                {
+                    // castling: the right, the rook, an empty path, and the king
+                    // neither in check nor crossing an attacked square
+                    temp_val = (dest_col == 6) ? 7 : 0;
+                    if (!(castle_rights & ((dest_col == 6) ? CASTLE_KINGSIDE : CASTLE_QUEENSIDE)))
+                        invalidmove++;
+                    else if (gboard[7][temp_val][0] != WHT_ROOK || isPieceBetweenLR(4, temp_val, 7))
+                        invalidmove++;
+                    else if (isKingInCheck(7, 4) == 1 || isKingInCheck(7, (4 + dest_col) / 2) == 1)
+                        invalidmove++;
+                }
+                else
+                {
+                    if ( ((src_row > dest_row) ? (src_row - dest_row) : (dest_row - src_row)) > 1)
+                        invalidmove++;
+                    if ( ((src_col > dest_col) ? (src_col - dest_col) : (dest_col - src_col)) > 1)
+                        invalidmove++;
+                }
                 if (isKingInCheck(dest_row, dest_col) == 1)
                     invalidmove++;
                 break;
@@ -705,7 +1297,8 @@ unsigned char isMoveIsValid(char src_row, char src_col, char dest_row, char dest
                         {
                             // check if enemy piece is in diagonal square 
                             // (we already checked if square has a white piece, so only empty square is left)
-                            if (dest_square == EMPTY)
+                            // or black's pawn has just passed it (en passant)
+                            if (dest_square == EMPTY && !(src_row == 3 && dest_col == ep_col))
                             {
                                 invalidmove++;
                             }
@@ -759,6 +1352,22 @@ void MovePiece(unsigned char from_row, unsigned char from_col, unsigned char to_
         }
     }
 
+    if(vdc_render)
+    {
+        gboard[to_row][to_col][0] = gboard[from_row][from_col][0];
+        gboard[from_row][from_col][0] = EMPTY;
+        VdcDrawSquare(from_row, from_col);
+        VdcDrawSquare(to_row, to_col);
+        return;
+    }
+
+    // both squares appear together; glyphs reach one pixel past the square
+    BeginBackDraw();
+    MarkDirty(vboard[from_row][from_col].top, vboard[from_row][from_col].bot,
+        vboard[from_row][from_col].left, vboard[from_row][from_col].right + sc_width);
+    MarkDirty(vboard[to_row][to_col].top, vboard[to_row][to_col].bot,
+        vboard[to_row][to_col].left, vboard[to_row][to_col].right + sc_width);
+
     // clear source square
     pattern = gboard[from_row][from_col][1];
     DrawStdRect(pattern, &vboard[from_row][from_col]);
@@ -778,16 +1387,25 @@ void MovePiece(unsigned char from_row, unsigned char from_col, unsigned char to_
     piece = GetPieceChar(to_row, to_col);
     PutChar(piece, 50+(18*to_row), (27 * sc_width) + ((20*to_col) * sc_width) ) ;
 
+    EndBackDraw();
 }
 
 void MouseClickHandler() 
 {
     struct window *rect;
     unsigned char hittest;
-    unsigned char r,c,z,m;
+    static const unsigned char promoted[4] = { BLK_KNIGHT, BLK_BISHOP, BLK_ROOK, BLK_QUEEN };
+    unsigned char r,c,z,m,piece;
+    struct chess_move user, reply;
     struct pixel  location;
     unsigned short loop;
-    unsigned char invalidmove;
+    unsigned char invalidmove, result;
+
+    PROBE_BEGIN(PHASE_INPUT);
+
+#ifdef PHASE_PROBES
+    HideTimings();
+#endif
 
     DrawSprite(2,square_cursor);
     DrawSprite(3,badmove_cursor);
@@ -809,6 +1427,7 @@ void MouseClickHandler()
                         tctr++;
                         if(tctr==3)
                             tctr=0;
+                        PROBE_END(PHASE_INPUT);
                         old_otherPressVec();
                         return;
                     }
@@ -842,6 +1461,7 @@ void MouseClickHandler()
                                 sel_col1 = c;
                                 tctr=1;
                                 
+                                PROBE_END(PHASE_INPUT);
                                 old_otherPressVec();
                                 return;
                             }
@@ -854,6 +1474,7 @@ void MouseClickHandler()
                                 sel_row1 = 255;
                                 sel_col1 = 255;
                                 
+                                PROBE_END(PHASE_INPUT);
                                 old_otherPressVec();
                                 return;
                             }
@@ -864,7 +1485,9 @@ void MouseClickHandler()
                         {
                             // this click is for the selected destination square
                             // first, check if the move is valid for the selected piece.
+                            PROBE_BEGIN(PHASE_VALIDATE);
                             invalidmove = isMoveIsValid(sel_row1, sel_col1, r,c);
+                            PROBE_END(PHASE_VALIDATE);
 
                             if(invalidmove != 0)
                             {
@@ -885,6 +1508,7 @@ void MouseClickHandler()
                                 // reset click variables
                                 sel_row1 = 255;
                                 sel_col1 = 255;
+                                PROBE_END(PHASE_INPUT);
                                 old_otherPressVec();
                                 return;
                             }
@@ -894,56 +1518,117 @@ void MouseClickHandler()
                                 // move the piece, remove the selection sprite,
                                 // execute the move with the engine, and await the AI's turn
 
+                                piece = gboard[sel_row1][sel_col1][0];
+                                user.src = SQUARE(sel_row1, sel_col1);
+                                user.dst = SQUARE(r, c);
+
+                                BeginBackDraw();
                                 UpdateNotation(0, sel_row1, sel_col1, r, c);
+                                PROBE_BEGIN(PHASE_DRAW);
+                                if (piece == WHT_PAWN && c != sel_col1 && gboard[r][c][0] == EMPTY)
+                                {
+                                    // en passant: the pawn taken steps under ours
+                                    MovePiece(sel_row1, c, r, c);
+                                    user.src |= MOVE_EP;
+                                }
+                                if (piece == WHT_PAWN && r == 0)
+                                    gboard[sel_row1][sel_col1][0] = WHT_QUEEN;
                                 MovePiece(sel_row1, sel_col1, r, c);
+                                if (piece == WHT_KING && (c == sel_col1 + 2 || c + 2 == sel_col1))
+                                {
+                                    MovePiece(7, (c > sel_col1) ? 7 : 0, 7, (c > sel_col1) ? 5 : 3);
+                                    user.src |= MOVE_CASTLE;
+                                }
+                                PROBE_END(PHASE_DRAW);
                                 DisablSprite(2);
-                                
+                                HideHints();
+                                KeepCastleRights(MOVE_SQUARE(user.src));
+                                ep_col = 255;
+
                                 // Here we inform the chess engine the player move
-                                memset(&user_move[0], 0, sizeof(user_move));
-                                strcpy(user_move, gbnotation[sel_row1][sel_col1]);
-                                strcat(user_move, gbnotation[r][c]);
 
-                                playerMove();
+                                LoadOverlay(active_engine->overlay);
+                                active_engine->make_user_move(&user);
 
                                 // we have notified the engine of our move.
                                 // now await AI move
 
                                 UpdateStatus("Black is thinking...");
+                                EndBackDraw();
+
+                                PROBE_BEGIN(PHASE_ENGINE);
+                                active_engine->start_search();
+                                while (active_engine->poll_search() == SEARCH_RUNNING)
+                                    UpdateStats();
 
-                                memset(&ai_move[0], 0, sizeof(ai_move));
-                                gameState = aiMove();
+                                result = active_engine->get_best_move(&reply);
+                                gameState = (result == MOVE_FOUND) ? INPROGRESS : STOPPED;
+                                PROBE_END(PHASE_ENGINE);
+
+                                if (active_engine->learn)
+                                    learn_changed = 1;
+
+                                UpdateStats();
+                                if (log_enabled)
+                                {
+                                    LoadOverlay(OVERLAY_LOG);
+                                    WriteSearchLog(&user, (gameState == STOPPED) ? 0 : &reply);
+                                }
 
                                 if (gameState == STOPPED)
                                 {
-                                    // a checkmate has occurred
-                                    UpdateStatus("Checkmate!");
+                                    // a checkmate or stalemate has occurred
+                                    UpdateStatus((result == MOVE_STALEMATE) ? "Stalemate." : "Checkmate!");
+                                    KeepLearning();
 
                                     sel_row1 = 255;
                                     sel_col1 = 255;
 
+                                    PROBE_END(PHASE_INPUT);
+                                    PROBE_NEXT();
+
                                     old_otherPressVec();
                                     return;
                                 }
                                 else 
                                 {
+                                    BeginBackDraw();
                                     UpdateStatus("Your move.");
 
-                                    // ai_move[] string now contains the ai move
-                                    // translate the string to piece movement
-                                    c = xlateCol(ai_move[0]);
-                                    r = xlateRow(ai_move[1]);
-                                    m = xlateCol(ai_move[2]);
-                                    z = xlateRow(ai_move[3]);
+                                    // translate the engine's move to piece movement
+                                    r = SQUARE_ROW(MOVE_SQUARE(reply.src));
+                                    c = SQUARE_COL(reply.src);
+                                    z = SQUARE_ROW(MOVE_SQUARE(reply.dst));
+                                    m = SQUARE_COL(reply.dst);
+                                    piece = gboard[r][c][0];
                                     UpdateNotation(1, r, c, z, m);
+                                    PROBE_BEGIN(PHASE_DRAW);
+                                    if (MOVE_FLAG(reply) == MOVE_EP)
+                                        MovePiece(r, m, z, m);
+                                    if (piece == BLK_PAWN && z == 7)
+                                        gboard[r][c][0] = (MOVE_FLAG(reply) == MOVE_PROMOTE)
+                                            ? promoted[PROMOTION_TYPE(reply) - 4] : BLK_QUEEN;
                                     MovePiece(r,c,z,m);
+                                    if (MOVE_FLAG(reply) == MOVE_CASTLE)
+                                        MovePiece(0, (m > c) ? 7 : 0, 0, (m > c) ? 5 : 3);
+                                    PROBE_END(PHASE_DRAW);
+                                    KeepCastleRights(MOVE_SQUARE(reply.dst));
+                                    ep_col = (piece == BLK_PAWN && z == r + 2) ? m : 255;
 
                                     // let player know if king is in check
                                     if (isKingInCheck(255,255) == 1)
                                         UpdateStatus("**Check!**");
+                                    EndBackDraw();
+
+                                    if (analysis_enabled)
+                                        ShowHints();
 
                                     sel_row1 = 255;
                                     sel_col1 = 255;
 
+                                    PROBE_END(PHASE_INPUT);
+                                    PROBE_NEXT();
+
                                     old_otherPressVec();
                                     return;
                                 }
@@ -955,15 +1640,361 @@ void MouseClickHandler()
         }
     }
 
+    PROBE_END(PHASE_INPUT);
+
     old_otherPressVec();
 }
 
+// white's castling rights after a move from or to sq
+void KeepCastleRights(unsigned char sq)
+{
+    if (sq == SQUARE(7, 4))
+        castle_rights = 0;
+    else if (sq == SQUARE(7, 7))
+        castle_rights &= ~CASTLE_KINGSIDE;
+    else if (sq == SQUARE(7, 0))
+        castle_rights &= ~CASTLE_QUEENSIDE;
+}
+
 void NewGameMenuHandler(void) {
 
     RecoverAllMenus();
     NewGame();
 }
 
+// Switch to the next engine.  It takes over the game as it stands; the menu
+// is only reachable when white is to move.
+void EngineMenuHandler(void)
+{
+    unsigned char squares[64];
+    unsigned char row, col;
+    char line[24];
+
+    RecoverAllMenus();
+
+    if (++engine_choice == ENGINE_COUNT)
+        engine_choice = 0;
+    active_engine = engines[engine_choice];
+
+    for (row = 0; row < 8; row++)
+        for (col = 0; col < 8; col++)
+            squares[row * 8 + col] = gboard[row][col][0];
+
+    LoadOverlay(active_engine->overlay);
+    active_engine->set_position(squares, WHT);
+
+    strcpy(line, "Engine: ");
+    strcat(line, active_engine->name);
+    UpdateStatus(line);
+
+    DoMenu((struct menu *)&mainMenu);
+}
+
+// the solver's node count on the statistics line
+void MateProgress(struct mate_search *ms)
+{
+    char line[24];
+
+    line[0] = 0;
+    AppendNumber(line, ms->nodes);
+    strcat(line, "n");
+    ShowStatsLine(line);
+}
+
+// Look for a mate by white from the position on the board, in at most
+// MATE_MENU_MOVES moves, and show the line or that there is none.  The
+// solver works on BMCP's board, set up from ours unless it is the engine
+// playing, which knows the castling rights as well.  It has an overlay of
+// its own; the engine's is loaded again for the next move it plays.
+void MateMenuHandler(void)
+{
+    unsigned char squares[64];
+    unsigned char row, col, i, result;
+    unsigned int entries = 16;
+    struct mate_search *ms;
+    char title[24], line[32];
+
+    RecoverAllMenus();
+
+    ms = malloc(sizeof(struct mate_search));
+    while (ms && (entries * 2) * sizeof(struct mate_entry) <= MATE_MEMORY())
+        entries *= 2;
+    if (!ms || !(ms->table = malloc(entries * sizeof(struct mate_entry))))
+    {
+        free(ms);
+        DlgBoxOk("Not enough memory", "to solve.");
+        DoMenu((struct menu *)&mainMenu);
+        return;
+    }
+
+    ms->mask = entries - 1;
+    ms->checks_only = 1;
+    ms->limit = 0;
+    ms->progress = MateProgress;
+
+    UpdateStatus("Solving...");
+    LoadOverlay(OVERLAY_ENGINE);
+    if (active_engine != &bmcp_engine)
+    {
+        for (row = 0; row < 8; row++)
+            for (col = 0; col < 8; col++)
+                squares[row * 8 + col] = gboard[row][col][0];
+        bmcp_set_position(squares, WHT);
+    }
+    LoadOverlay(OVERLAY_MATE);
+    result = mate_solve(ms, MATE_MENU_MOVES);
+
+    strcpy(title, "No mate in ");
+    line[0] = 0;
+    if (result == MATE_FOUND)
+    {
+        strcpy(title, "Mate in ");
+        for (i = 0; i < ms->line_length; i++)
+        {
+            strcat(line, gbnotation[SQUARE_ROW(MOVE_SQUARE(ms->line[i].src))][SQUARE_COL(ms->line[i].src)]);
+            strcat(line, gbnotation[SQUARE_ROW(MOVE_SQUARE(ms->line[i].dst))][SQUARE_COL(ms->line[i].dst)]);
+            strcat(line, " ");
+        }
+    }
+    else
+        strcpy(line, "giving checks only.");
+    AppendNumber(title, (result == MATE_FOUND) ? ms->moves : MATE_MENU_MOVES);
+
+    free(ms->table);
+    free(ms);
+
+    UpdateStatus("Your move.");
+    DlgBoxOk(title, line);
+    DoMenu((struct menu *)&mainMenu);
+}
+
+// White's best HINT_MOVES moves from one multi-PV search by BMCP, set up
+// from our board unless it is the engine playing, as for "solve mate".
+// Their squares are marked on the board and the moves with their scores in
+// pawns go on the statistics line.
+void ShowHints(void)
+{
+    struct chess_move moves[HINT_MOVES];
+    int scores[HINT_MOVES];
+    unsigned char squares[64];
+    unsigned char row, col, count, i, sq, sprite;
+    struct pixel location;
+    char line[32];
+
+    LoadOverlay(OVERLAY_ENGINE);
+    if (active_engine != &bmcp_engine)
+    {
+        for (row = 0; row < 8; row++)
+            for (col = 0; col < 8; col++)
+                squares[row * 8 + col] = gboard[row][col][0];
+        bmcp_set_position(squares, WHT);
+    }
+    count = bmcp_hint(moves, scores, HINT_MOVES);
+
+    HideHints();
+
+    // calls TempHideMouse for C128
+    if (ISGEOS128)
+    {
+        if(C128_80_COL_MODE) {
+            TEMP_HIDE_MOUSE
+        }
+    }
+
+    line[0] = 0;
+    for (i = 0; i < count; i++)
+    {
+        if (i)
+            strcat(line, " ");
+        strcat(line, gbnotation[SQUARE_ROW(MOVE_SQUARE(moves[i].src))][SQUARE_COL(moves[i].src)]);
+        strcat(line, gbnotation[SQUARE_ROW(MOVE_SQUARE(moves[i].dst))][SQUARE_COL(moves[i].dst)]);
+        // mates in moves as the UCI front end gives them, negative when mated
+        if (scores[i] > MATE_BOUND)
+        {
+            strcat(line, " mate ");
+            AppendNumber(line, (MATE - scores[i] + 1) / 2);
+        }
+        else if (scores[i] < -MATE_BOUND)
+        {
+            strcat(line, " mate -");
+            AppendNumber(line, (MATE + scores[i]) / 2);
+        }
+        else
+        {
+            strcat(line, (scores[i] < 0) ? " -" : " +");
+            AppendTenths(line, ((scores[i] < 0) ? -scores[i] : scores[i]) / 10);
+        }
+
+        for (sprite = HINT_SPRITE + 2 * i; sprite < HINT_SPRITE + 2 * i + 2; sprite++)
+        {
+            sq = MOVE_SQUARE((sprite & 1) ? moves[i].dst : moves[i].src);
+            location.y = vboard[SQUARE_ROW(sq)][SQUARE_COL(sq)].top;
+            location.x = vboard[SQUARE_ROW(sq)][SQUARE_COL(sq)].left;
+            DrawSprite(sprite, square_cursor);
+            PosSprite(sprite, &location);
+            EnablSprite(sprite);
+        }
+    }
+
+    ShowStatsLine(count ? line : "No hint.");
+}
+
+void HideHints(void)
+{
+    unsigned char sprite;
+
+    for (sprite = HINT_SPRITE; sprite < HINT_SPRITE + 2 * HINT_MOVES; sprite++)
+        DisablSprite(sprite);
+}
+
+void HintMenuHandler(void)
+{
+    RecoverAllMenus();
+
+    if (gameState == INPROGRESS)
+        ShowHints();
+
+    DoMenu((struct menu *)&mainMenu);
+}
+
+// analysis shows the hints again after every reply
+void AnalysisMenuHandler(void)
+{
+    RecoverAllMenus();
+
+    analysis_enabled = !analysis_enabled;
+    UpdateStatus(analysis_enabled ? "Analysis on." : "Analysis off.");
+
+    if (analysis_enabled && gameState == INPROGRESS)
+        ShowHints();
+    else
+        HideHints();
+
+    DoMenu((struct menu *)&mainMenu);
+}
+
+#ifdef PHASE_PROBES
+
+unsigned char timings_shown = 0;
+
+// the move panel's inside
+void TimingsWindow(struct window *area)
+{
+    area->top = 46;
+    area->bot = 176;
+    area->left = 208 * sc_width;
+    area->right = 311 * sc_width;
+}
+
+// Phase times in ms over the move panel: the last move's total and the
+// longest single run over the last PROBE_MOVES moves.  Drawn on the screen
+// only, so the move log comes back from the background buffer on the next
+// click.
+void ShowTimings(void)
+{
+    static const char *names[PHASE_COUNT] = { "input", "check", "engine", "draw", "disk" };
+    struct probe_entry *last;
+    struct window area;
+    unsigned long longest;
+    unsigned char phase, i, y = 55;
+    char line[12];
+
+    last = &probe_ring[(probe_current + PROBE_MOVES - (probe_moves ? 1 : 0)) % PROBE_MOVES];
+
+    dispBufferOn = ST_WR_FORE;
+    TimingsWindow(&area);
+    SetPattern(0);
+    InitDrawWindow(&area);
+    Rectangle();
+
+    UseSystemFont();
+    PutString("ms", y, 212 * sc_width);
+    PutString("last", y, 245 * sc_width);
+    PutString("max", y, 280 * sc_width);
+
+    for(phase = 0; phase < PHASE_COUNT; phase++)
+    {
+        y += 12;
+
+        longest = 0;
+        for(i = 0; i < PROBE_MOVES; i++)
+            if(probe_ring[i].longest[phase] > longest)
+                longest = probe_ring[i].longest[phase];
+
+        PutString((char *)names[phase], y, 212 * sc_width);
+        line[0] = 0;
+        AppendNumber(line, last->total[phase] / PROBE_TICKS_PER_MS);
+        PutString(line, y, 245 * sc_width);
+        line[0] = 0;
+        AppendNumber(line, longest / PROBE_TICKS_PER_MS);
+        PutString(line, y, 280 * sc_width);
+    }
+
+    dispBufferOn = ST_WR_FORE | ST_WR_BACK;
+    timings_shown = 1;
+}
+
+void HideTimings(void)
+{
+    struct window area;
+
+    if(!timings_shown)
+        return;
+
+    TimingsWindow(&area);
+    InitDrawWindow(&area);
+    RecoverRectangle();
+    timings_shown = 0;
+}
+
+void TimingsMenuHandler(void)
+{
+    RecoverAllMenus();
+    ShowTimings();
+    DoMenu((struct menu *)&mainMenu);
+}
+
+#endif
+
+void QuitMenuHandler(void)
+{
+    RecoverAllMenus();
+    KeepLearning();
+    EnterDeskTop();
+}
+
+void SearchLogMenuHandler(void)
+{
+    RecoverAllMenus();
+
+    if (log_enabled)
+    {
+        log_enabled = 0;
+        UpdateStatus("Search log off.");
+    }
+    else
+    {
+        if (OpenRecordFile(log_name) != 0)
+        {
+            LoadOverlay(OVERLAY_LOG);
+            CreateSearchLog();
+        }
+        else
+            CloseRecordFile();
+
+        if (OpenRecordFile(log_name) != 0)
+            DlgBoxOk("Error accessing log.", "'geochess log' not created.");
+        else
+        {
+            CloseRecordFile();
+            log_enabled = 1;
+            UpdateStatus("Search log on.");
+        }
+    }
+
+    DoMenu((struct menu *)&mainMenu);
+}
+
 void Switch4080MenuHandler(void)
 {
     if (ISGEOS128)
@@ -984,9 +2015,14 @@ void Switch4080MenuHandler(void)
             
             
         SetNewMode();
+        LoadOverlay(OVERLAY_SETUP);
+        PROBE_BEGIN(PHASE_DISK);
         LoadFont();
+        PROBE_END(PHASE_DISK);
         InitScreen();
+        PROBE_BEGIN(PHASE_DRAW);
         InitBoard(1);
+        PROBE_END(PHASE_DRAW);
         InitMovePanel();
     }
     else
@@ -996,6 +2032,29 @@ void Switch4080MenuHandler(void)
     DoMenu((struct menu *)&mainMenu);
 }
 
+// Read one of our overlay records into the overlay area, unless it is
+// already there or 0 (resident code).  Other VLIR files are opened by the
+// overlays themselves, so our own file is only open while loading.
+void LoadOverlay(unsigned char record)
+{
+    if (record == 0 || record == current_overlay)
+        return;
+
+    PROBE_BEGIN(PHASE_DISK);
+    current_overlay = 0;
+
+    if (OpenRecordFile(app_name) != 0 || PointRecord(record) != 0 ||
+        ReadRecord(OVERLAY_AREA, OVERLAY_SIZE) != 0)
+    {
+        DlgBoxOk("Error loading program module.", app_name);
+        EnterDeskTop();
+    }
+
+    CloseRecordFile();
+    current_overlay = record;
+    PROBE_END(PHASE_DISK);
+}
+
 void hook_into_system(void) {
         old_otherPressVec = otherPressVec;
         otherPressVec = MouseClickHandler;
@@ -1003,8 +2062,6 @@ void hook_into_system(void) {
 
 void remove_hook(void) {
         otherPressVec = old_otherPressVec;
-
-        free((struct menu *)&mainMenu);
 }
 
 
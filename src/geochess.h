@@ -25,27 +25,81 @@
 #define TEMP_HIDE_MOUSE    asm("jsr $c2d7");
 
 #define FONTBUFFERSIZE  5048 //4104
+#define LOGBUFFERSIZE   512
+#define DIRTY_MAX       8
 #define BOARD_TOP       33
 #define BOARD_LEFT      26
 #define SQUARE_WIDTH    18
 #define SQUARE_HEIGHT   16
 
-#define EMPTY       0
-#define WHT_KING    1
-#define WHT_QUEEN   2
-#define WHT_BISHOP  3
-#define WHT_KNIGHT  4
-#define WHT_ROOK    5
-#define WHT_PAWN    6
-#define BLK_KING    7
-#define BLK_QUEEN   8
-#define BLK_BISHOP  9
-#define BLK_KNIGHT  10
-#define BLK_ROOK    11
-#define BLK_PAWN    12
-
-#define WHT   0
-#define BLK   1
+// VLIR records of the application.  Record 0 is the resident core: main
+// loop, board state and everything used on every move.  Only one overlay is
+// in memory at a time; the engine's stays there during play so moves cost
+// no disk access.
+#define OVERLAY_ENGINE  1       // search, move generation, evaluation
+#define OVERLAY_SETUP   2       // fonts, screen, board and panel setup
+#define OVERLAY_LOG     3       // search log and learning files
+#define OVERLAY_TINY    4       // the tiny engine
+#define OVERLAY_MATE    5       // the mate solver
+
+// the engine headers put their code into these overlays
+#define ENGINE_OVERLAY  OVERLAY_ENGINE
+#define TINY_OVERLAY    OVERLAY_TINY
+#define MATE_OVERLAY    OVERLAY_MATE
+
+// "solve mate" looks this many moves deep, giving checks only, with a table
+// in what the heap has left (a C64's worth on the host stand-in)
+#define MATE_MENU_MOVES 3
+#ifdef GEOS_HOST
+#define MATE_MEMORY()   16384U
+#else
+#define MATE_MEMORY()   _heapmaxavail()
+#endif
+
+// "hint" shows white's best HINT_MOVES moves (up to MULTIPV_MAX), marked
+// with the square cursor by a pair of sprites each from HINT_SPRITE on
+#define HINT_MOVES      2
+#define HINT_SPRITE     4
+
+// engine used at startup, an index into engines[] of geochess.c
+#ifndef DEFAULT_ENGINE
+#define DEFAULT_ENGINE  0
+#endif
+
+// CIA #1 time-of-day clock, used to time the engine's search.  The host
+// stand-in of geos-host/ supplies its own.
+#ifndef GEOS_HOST
+#define CIA1_TOD10THS   (*(volatile unsigned char *)0xdc08)
+#define CIA1_TODSEC     (*(volatile unsigned char *)0xdc09)
+#define CIA1_TODMIN     (*(volatile unsigned char *)0xdc0a)
+#define CIA1_TODHR      (*(volatile unsigned char *)0xdc0b)
+#endif
+
+unsigned long ReadTodTenths(void);
+
+#define ENGINE_TICKS()          ReadTodTenths()
+#define ENGINE_TICKS_PER_SEC    10UL
+
+// piece codes, squares and the engine interface
+#include "geochess-engine.h"
+
+// C128 VDC (80 column) registers
+#define VDC_ADDR        (*(volatile unsigned char *)0xd600)
+#define VDC_DATA        (*(volatile unsigned char *)0xd601)
+#define VDC_UPDATE_HI   18
+#define VDC_UPDATE_LO   19
+#define VDC_CONTROL     24      // bit 7 set: word count copies instead of fills
+#define VDC_WORD_COUNT  30
+#define VDC_DATA_REG    31
+#define VDC_LINE_BYTES  80
+
+// An 80 column square is 37 pixels starting 6 pixels into a VDC byte, and
+// the columns are 40 pixels (5 bytes) apart: 2 + 32 + 3 pixels over 6 bytes.
+#define VDC_SQUARE_BYTES    6
+#define VDC_FIRST_MASK      0x03
+#define VDC_LAST_MASK       0xe0
+#define VDC_SQUARE_ADDR(row, col)   ((BOARD_TOP + 1 + (row) * (SQUARE_HEIGHT + 2)) * VDC_LINE_BYTES \
+                                     + (((BOARD_LEFT + 1) * 2) >> 3) + (col) * 5)
 
 #define WHT_KING_WHT_SQR    'A'
 #define WHT_QUEEN_WHT_SQR   'B'
@@ -155,6 +209,10 @@ char *gbnotation[8][8] = {
     {"a1", "b1", "c1", "d1", "e1", "f1", "g1", "h1"}
 };
 
+// castle_rights
+#define CASTLE_KINGSIDE     1
+#define CASTLE_QUEENSIDE    2
+
 enum GameStates {
     INPROGRESS,
     STOPPED
@@ -163,25 +221,89 @@ enum GameStates {
 
 struct window vboard[8][8];         // the visual board rectangles
 unsigned char gboard[8][8][2];      // the actual game board (3rd dimension is square color, piece)
-char user_move[5];   
+char user_move[5];                  // move text for the notation panel
+char ai_move[5];
 char fontbuffer[FONTBUFFERSIZE];
+unsigned char vdc_render = 0;       // 80 column board drawn straight into VDC memory
+struct window dirty[DIRTY_MAX];     // areas drawn into the background buffer only
+unsigned char dirty_count = 0;
+unsigned char back_draw_depth = 0;  // nesting of BeginBackDraw()
+unsigned char vdc_squares[24][SQUARE_HEIGHT + 1][VDC_SQUARE_BYTES];    // glyphs 'A'..'X' on their squares
 unsigned char sel_row1 = 255;
 unsigned char sel_col1 = 255;
+unsigned char castle_rights = CASTLE_KINGSIDE | CASTLE_QUEENSIDE;  // white's, left this game
+unsigned char ep_col = 255;         // column black's pawn just moved two squares on, or 255
 unsigned char tctr = 0;
 unsigned char notation_row_count = 0;
 unsigned char notation_text_position = 55;
 enum GameStates gameState = INPROGRESS;
 
+// optional search log: one VLIR record per game, rewritten after each engine move
+char log_name[] = "geochess log";
+char logbuffer[LOGBUFFERSIZE];
+unsigned int log_length = 0;
+unsigned char log_record = 255;     // 255 = append a new record on the next write
+unsigned char log_enabled = 0;
+unsigned char analysis_enabled = 0; // hints after every reply
+unsigned char move_number = 0;
+struct fileheader log_header;
+
+// the engines' learning tables, one VLIR record per entry of engines[]
+char learn_name[] = "geochess learn";
+unsigned char learn_changed = 0;    // an engine searched since the last write
+
+const char log_icon[63] = {
+ 0b11111111,0b11111111,0b11111110,
+ 0b10000000,0b00000000,0b00000010,
+ 0b10000000,0b00000000,0b00000010,
+ 0b10011111,0b11111111,0b11110010,
+ 0b10000000,0b00000000,0b00000010,
+ 0b10011111,0b11111111,0b11000010,
+ 0b10000000,0b00000000,0b00000010,
+ 0b10011111,0b11111111,0b11110010,
+ 0b10000000,0b00000000,0b00000010,
+ 0b10011111,0b11111111,0b00000010,
+ 0b10000000,0b00000000,0b00000010,
+ 0b10011111,0b11111111,0b11110010,
+ 0b10000000,0b00000000,0b00000010,
+ 0b10011111,0b11111100,0b00000010,
+ 0b10000000,0b00000000,0b00000010,
+ 0b10011111,0b11111111,0b11110010,
+ 0b10000000,0b00000000,0b00000010,
+ 0b10011111,0b11111111,0b11000010,
+ 0b10000000,0b00000000,0b00000010,
+ 0b10000000,0b00000000,0b00000010,
+ 0b11111111,0b11111111,0b11111110 };
+
 void_func old_otherPressVec;
 
+// overlay area, from the linker
+#ifndef OVERLAY_AREA
+extern void _OVERLAYADDR__;
+extern void _OVERLAYSIZE__;
+#define OVERLAY_AREA    ((char *)&_OVERLAYADDR__)
+#define OVERLAY_SIZE    ((unsigned)&_OVERLAYSIZE__)
+#endif
+
+char app_name[17];                  // our own file, holding the overlays
+unsigned char current_overlay = 0;  // 0 = none loaded
+
 
 // Function prototypes
 void Switch4080MenuHandler(void);
 void NewGameMenuHandler(void);
+void SearchLogMenuHandler(void);
+void EngineMenuHandler(void);
+void MateMenuHandler(void);
+void HintMenuHandler(void);
+void AnalysisMenuHandler(void);
+void TimingsMenuHandler(void);
+void QuitMenuHandler(void);
 
 void InitScreen(void);
 void InitBoard(unsigned char initialPosition);
 void NewGame(void);
+void KeepCastleRights(unsigned char sq);
 
 void LoadFont(void);
 void hook_into_system(void);
@@ -189,42 +311,85 @@ void remove_hook(void);
 void InitMovePanel(void);
 
 void UpdateStatus(char *message);
+void UpdateStats(void);
+void ShowStatsLine(char *line);
+void ShowHints(void);
+void HideHints(void);
+void WriteSearchLog(struct chess_move *user, struct chess_move *reply);
 unsigned char GetPieceChar(unsigned char row, unsigned char col);
+void BeginBackDraw(void);
+void MarkDirty(unsigned char top, unsigned char bot, unsigned int left, unsigned int right);
+void EndBackDraw(void);
+void VdcBuildSquares(void);
+void VdcDrawSquare(unsigned char row, unsigned char col);
+void LoadOverlay(unsigned char record);
+void LoadLearning(void);
+void SaveLearning(void);
+void KeepLearning(void);
+void ShowTimings(void);
+void HideTimings(void);
 
 // main menu definition
 
-const void subMenu64 = {
-	(char)12, (char)40,
-	(int)0, (int)66,
-	(char)(2 | VERTICAL),
-	"new game", (char)MENU_ACTION, (int)NewGameMenuHandler,
-	"quit", (char)MENU_ACTION, (int)EnterDeskTop,
-};
-
-const void subMenu128_40 = {
-	(char)12, (char)54,
-	(int)0, (int)66,
-	(char)(3 | VERTICAL),
-	"new game", (char)MENU_ACTION, (int)NewGameMenuHandler,
-	"switch 40/80", (char)MENU_ACTION, (int)Switch4080MenuHandler,
-	"quit", (char)MENU_ACTION, (int)EnterDeskTop,
-};
-
-const void subMenu128_80 = {
-	(char)12, (char)54,
-	(int)0, (int)90,
-	(char)(3 | VERTICAL),
-	"new game", (char)MENU_ACTION, (int)NewGameMenuHandler,
-	"switch 40/80", (char)MENU_ACTION, (int)Switch4080MenuHandler,
-	"quit", (char)MENU_ACTION, (int)EnterDeskTop,
-};
-
-
-const void mainMenu = {
-	(char)0, (char)15,
-	(int)0, (int)27,
-	(char)(1 | HORIZONTAL),
-	"geos", (char)SUB_MENU, (int)&subMenu64,
-};
+// Menus are packed byte tables for GEOS.  The host stand-in builds real
+// struct menus from the same lists.
+#ifdef GEOS_HOST
+#define MENU(name, top, bot, left, right, items)    struct menu name = { { top, bot, left, right }, items, {
+#define MENU_ITEM(text, type, target)               { text, type, (void *)(target) },
+#define MENU_END                                    } };
+#else
+#define MENU(name, top, bot, left, right, items)    const void name = { (char)(top), (char)(bot), (int)(left), (int)(right), (char)(items),
+#define MENU_ITEM(text, type, target)               text, (char)(type), (int)(target),
+#define MENU_END                                    };
+#endif
+
+// "timings" shows the phase probes of geochess-probe.h, when built in
+#ifdef PHASE_PROBES
+#define TIMINGS_ITEMS   1
+#define TIMINGS_ITEM    MENU_ITEM("timings", MENU_ACTION, TimingsMenuHandler)
+#else
+#define TIMINGS_ITEMS   0
+#define TIMINGS_ITEM
+#endif
+
+MENU(subMenu64, 12, 110 + 14 * TIMINGS_ITEMS, 0, 66, (7 + TIMINGS_ITEMS) | VERTICAL)
+	MENU_ITEM("new game", MENU_ACTION, NewGameMenuHandler)
+	MENU_ITEM("engine", MENU_ACTION, EngineMenuHandler)
+	MENU_ITEM("solve mate", MENU_ACTION, MateMenuHandler)
+	MENU_ITEM("hint", MENU_ACTION, HintMenuHandler)
+	MENU_ITEM("analysis", MENU_ACTION, AnalysisMenuHandler)
+	MENU_ITEM("search log", MENU_ACTION, SearchLogMenuHandler)
+	TIMINGS_ITEM
+	MENU_ITEM("quit", MENU_ACTION, QuitMenuHandler)
+MENU_END
+
+MENU(subMenu128_40, 12, 124 + 14 * TIMINGS_ITEMS, 0, 66, (8 + TIMINGS_ITEMS) | VERTICAL)
+	MENU_ITEM("new game", MENU_ACTION, NewGameMenuHandler)
+	MENU_ITEM("engine", MENU_ACTION, EngineMenuHandler)
+	MENU_ITEM("solve mate", MENU_ACTION, MateMenuHandler)
+	MENU_ITEM("hint", MENU_ACTION, HintMenuHandler)
+	MENU_ITEM("analysis", MENU_ACTION, AnalysisMenuHandler)
+	MENU_ITEM("switch 40/80", MENU_ACTION, Switch4080MenuHandler)
+	MENU_ITEM("search log", MENU_ACTION, SearchLogMenuHandler)
+	TIMINGS_ITEM
+	MENU_ITEM("quit", MENU_ACTION, QuitMenuHandler)
+MENU_END
+
+MENU(subMenu128_80, 12, 124 + 14 * TIMINGS_ITEMS, 0, 90, (8 + TIMINGS_ITEMS) | VERTICAL)
+	MENU_ITEM("new game", MENU_ACTION, NewGameMenuHandler)
+	MENU_ITEM("engine", MENU_ACTION, EngineMenuHandler)
+	MENU_ITEM("solve mate", MENU_ACTION, MateMenuHandler)
+	MENU_ITEM("hint", MENU_ACTION, HintMenuHandler)
+	MENU_ITEM("analysis", MENU_ACTION, AnalysisMenuHandler)
+	MENU_ITEM("switch 40/80", MENU_ACTION, Switch4080MenuHandler)
+	MENU_ITEM("search log", MENU_ACTION, SearchLogMenuHandler)
+	TIMINGS_ITEM
+	MENU_ITEM("quit", MENU_ACTION, QuitMenuHandler)
+MENU_END
+
+
+MENU(mainMenu, 0, 15, 0, 27, 1 | HORIZONTAL)
+	MENU_ITEM("geos", SUB_MENU, &subMenu64)
+MENU_END
 
 #endif
\ No newline at end of file
@@ -0,0 +1,775 @@
+//===================================================================================
+//
+//                                  GEOCHESS
+//
+// geoChess is a chess game for GEOS under the Commodore 64 and 128 computers
+//
+// Written by Scott Hutter
+// Nov 2023
+//
+// You are free to modify this code as desired, as long as original author credit
+// is mentioned for both the geos code and the included AI engines
+//===================================================================================
+
+//*********************************************************************************
+//
+// Host stand-in for the GEOS calls of geochess.c, see geos.h.
+//
+//********************************************************************************
+
+#include <ctype.h>
+#include <string.h>
+#include <unistd.h>
+#include "geos.h"
+
+// every counted call, in report order
+#define HOST_CALLS \
+    X(SetPattern) X(InitDrawWindow) X(Rectangle) X(RecoverRectangle) X(ImprintRectangle) \
+    X(HorizontalLine) X(VerticalLine) X(UseSystemFont) X(LoadCharSet) X(PutChar) X(PutString) \
+    X(IsMseInRegion) X(DrawSprite) X(PosSprite) X(EnablSprite) X(DisablSprite) \
+    X(DoMenu) X(RecoverAllMenus) X(DlgBoxOk) X(SetNewMode) \
+    X(OpenRecordFile) X(CloseRecordFile) X(PointRecord) X(ReadRecord) X(WriteRecord) \
+    X(AppendRecord) X(SaveFile) X(VdcRead) X(VdcWrite)
+
+#define X(name) CALL_##name,
+enum { HOST_CALLS CALL_COUNT };
+#undef X
+
+#define X(name) #name,
+static const char *call_names[] = { HOST_CALLS };
+#undef X
+
+static unsigned long calls[CALL_COUNT];
+static unsigned long pixels_fore, pixels_back;
+
+#define COUNT(name)     (calls[CALL_##name]++)
+
+// GEOS error codes
+#define FILE_NOT_FOUND  5
+#define INV_RECORD      8
+#define BFR_OVERFLOW    11
+
+unsigned char dispBufferOn = ST_WR_FORE;
+unsigned char graphMode = 0;
+unsigned mouseXPos = 0;
+unsigned char mouseYPos = 0;
+void_func otherPressVec;
+
+unsigned char host_cia1_tod[4];
+char host_overlay_area[1];
+
+unsigned char host_fore[HOST_WIDTH_MAX / 8 * HOST_HEIGHT];
+unsigned char host_back[HOST_WIDTH_MAX / 8 * HOST_HEIGHT];
+struct host_sprite host_sprites[8];
+struct menu *host_menu;
+
+static unsigned char os_type;
+static const char *file_dir = ".";
+static const char *application = "";
+
+//*********************************************************************************
+// bitmap
+//********************************************************************************
+
+unsigned host_width(void)
+{
+    return ((os_type & GEOS128) && (graphMode & 0x80)) ? 640 : 320;
+}
+
+static void plot_in(unsigned char *bitmap, unsigned x, unsigned y, int set)
+{
+    unsigned char *p = bitmap + y * (host_width() / 8) + (x >> 3);
+    unsigned char bit = 0x80 >> (x & 7);
+
+    if(set)
+        *p |= bit;
+    else
+        *p &= ~bit;
+}
+
+static int point_in(unsigned char *bitmap, unsigned x, unsigned y)
+{
+    return (bitmap[y * (host_width() / 8) + (x >> 3)] >> (7 - (x & 7))) & 1;
+}
+
+// one pixel to the buffers selected by dispBufferOn
+static void plot(unsigned x, unsigned y, int set)
+{
+    if(x >= host_width() || y >= HOST_HEIGHT)
+        return;
+
+    if(dispBufferOn & ST_WR_FORE)
+    {
+        plot_in(host_fore, x, y, set);
+        pixels_fore++;
+    }
+
+    if(dispBufferOn & ST_WR_BACK)
+    {
+        plot_in(host_back, x, y, set);
+        pixels_back++;
+    }
+}
+
+//*********************************************************************************
+// graphics
+//********************************************************************************
+
+static unsigned char pattern_number;
+static struct window draw_window;
+
+// 0 is white and 1 black as in GEOS; the others are all drawn as GEOS
+// pattern 2, the 50% grey
+static int pattern_bit(unsigned x, unsigned y)
+{
+    if(pattern_number == 0)
+        return 0;
+    if(pattern_number == 1)
+        return 1;
+
+    return (x ^ y) & 1;
+}
+
+void SetPattern(unsigned char pattern)
+{
+    COUNT(SetPattern);
+    pattern_number = pattern;
+}
+
+void InitDrawWindow(struct window *win)
+{
+    COUNT(InitDrawWindow);
+    draw_window = *win;
+}
+
+void Rectangle(void)
+{
+    unsigned x, y;
+
+    COUNT(Rectangle);
+
+    for(y = draw_window.top; y <= draw_window.bot; y++)
+        for(x = draw_window.left; x <= draw_window.right; x++)
+            plot(x, y, pattern_bit(x, y));
+}
+
+// copy the draw window from one buffer to the other
+static void copy_window(unsigned char *from, unsigned char *to, unsigned long *counter)
+{
+    unsigned x, y;
+
+    for(y = draw_window.top; y <= draw_window.bot && y < HOST_HEIGHT; y++)
+    {
+        for(x = draw_window.left; x <= draw_window.right && x < host_width(); x++)
+        {
+            plot_in(to, x, y, point_in(from, x, y));
+            (*counter)++;
+        }
+    }
+}
+
+void RecoverRectangle(void)
+{
+    COUNT(RecoverRectangle);
+    copy_window(host_back, host_fore, &pixels_fore);
+}
+
+void ImprintRectangle(void)
+{
+    COUNT(ImprintRectangle);
+    copy_window(host_fore, host_back, &pixels_back);
+}
+
+void HorizontalLine(unsigned char pattern, unsigned char y, unsigned xstart, unsigned xend)
+{
+    unsigned x;
+
+    COUNT(HorizontalLine);
+
+    for(x = xstart; x <= xend; x++)
+        plot(x, y, (pattern >> (7 - (x & 7))) & 1);
+}
+
+void VerticalLine(unsigned char pattern, unsigned char ystart, unsigned char yend, unsigned x)
+{
+    unsigned y;
+
+    COUNT(VerticalLine);
+
+    for(y = ystart; y <= yend; y++)
+        plot(x, y, (pattern >> (7 - (y & 7))) & 1);
+}
+
+//*********************************************************************************
+// text
+//********************************************************************************
+
+static const unsigned char *font;      // loaded character set, or 0 for the system font
+
+static unsigned font_word(unsigned offset)
+{
+    return font[offset] | (font[offset + 1] << 8);
+}
+
+void UseSystemFont(void)
+{
+    COUNT(UseSystemFont);
+    font = 0;
+}
+
+void LoadCharSet(struct fontdesc *desc)
+{
+    COUNT(LoadCharSet);
+    font = (const unsigned char *)desc;
+}
+
+// draw a character with its top-left corner at (x, top), return its width
+static unsigned draw_char(unsigned char c, unsigned x, int top)
+{
+    unsigned row_bytes, index, start, width, line, i, bit;
+    const unsigned char *bits;
+
+    if(c < 32 || c > 127)
+        return 0;
+
+    if(!font)
+    {
+        // system font stand-in: a 6x9 cell, baseline 6, with a stamp made
+        // from the character code
+        for(line = 0; line < 9; line++)
+        {
+            bits = 0;
+            for(i = 0; i < 6; i++)
+            {
+                bit = (c != ' ') && line >= 1 && line <= 7 && i < 5 && ((c * (line + 3)) >> i) & 1;
+                plot(x + i, top + line, bit);
+            }
+        }
+
+        return 6;
+    }
+
+    row_bytes = font_word(1);
+    index = font_word(4) + (c - 32) * 2;
+    start = font_word(index);
+    width = font_word(index + 2) - start;
+    bits = font + font_word(6);
+
+    for(line = 0; line < font[3]; line++)
+    {
+        for(i = 0; i < width; i++)
+        {
+            bit = start + i;
+            plot(x + i, top + line, (bits[line * row_bytes + (bit >> 3)] >> (7 - (bit & 7))) & 1);
+        }
+    }
+
+    return width;
+}
+
+static int char_top(unsigned char y)
+{
+    return (int)y - (font ? font[0] : 6);
+}
+
+void PutChar(char c, unsigned char y, unsigned x)
+{
+    COUNT(PutChar);
+    draw_char(c, x, char_top(y));
+}
+
+void PutString(char *s, unsigned char y, unsigned x)
+{
+    COUNT(PutString);
+
+    for(; *s; s++)
+        x += draw_char(*s, x, char_top(y));
+}
+
+//*********************************************************************************
+// mouse, sprites and menus
+//********************************************************************************
+
+char IsMseInRegion(struct window *win)
+{
+    COUNT(IsMseInRegion);
+
+    return (mouseXPos >= win->left && mouseXPos <= win->right &&
+            mouseYPos >= win->top && mouseYPos <= win->bot) ? 255 : 0;
+}
+
+void DrawSprite(char sprite, const char *data)
+{
+    COUNT(DrawSprite);
+    host_sprites[sprite & 7].data = data;
+}
+
+void PosSprite(char sprite, struct pixel *position)
+{
+    COUNT(PosSprite);
+    host_sprites[sprite & 7].x = position->x;
+    host_sprites[sprite & 7].y = position->y;
+}
+
+void EnablSprite(char sprite)
+{
+    COUNT(EnablSprite);
+    host_sprites[sprite & 7].enabled = 1;
+}
+
+void DisablSprite(char sprite)
+{
+    COUNT(DisablSprite);
+    host_sprites[sprite & 7].enabled = 0;
+}
+
+void DoMenu(struct menu *menu)
+{
+    COUNT(DoMenu);
+    host_menu = menu;
+}
+
+void RecoverAllMenus(void)
+{
+    COUNT(RecoverAllMenus);
+}
+
+static void no_press(void)
+{
+}
+
+void host_click(unsigned x, unsigned char y)
+{
+    mouseXPos = x;
+    mouseYPos = y;
+
+    // GEOS calls otherPressVec on the press and on the release
+    otherPressVec();
+    otherPressVec();
+}
+
+static int select_in(struct menu *menu, const char *name)
+{
+    int i;
+
+    for(i = 0; i < (menu->number & 0x1f); i++)
+    {
+        struct menuitem *item = &menu->items[i];
+
+        if((item->type & SUB_MENU) && select_in(item->rest, name) == 0)
+            return 0;
+
+        if(!(item->type & SUB_MENU) && !strcmp(item->name, name))
+        {
+            ((void_func)item->rest)();
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+int host_menu_select(const char *name)
+{
+    return host_menu ? select_in(host_menu, name) : 1;
+}
+
+//*********************************************************************************
+// system
+//********************************************************************************
+
+char get_ostype(void)
+{
+    return os_type;
+}
+
+void MainLoop(void)
+{
+    // the replay driver runs the events
+}
+
+void EnterDeskTop(void)
+{
+    // straight out, the atexit() handlers would free GEOS memory
+    printf("EnterDeskTop\n");
+    fflush(stdout);
+    _exit(0);
+}
+
+char DlgBoxOk(const char *line1, const char *line2)
+{
+    COUNT(DlgBoxOk);
+    printf("dialog: %s / %s\n", line1, line2);
+    return 1;
+}
+
+void SetNewMode(void)
+{
+    COUNT(SetNewMode);
+
+    graphMode ^= 0x80;
+    memset(host_fore, 0, sizeof(host_fore));
+    memset(host_back, 0, sizeof(host_back));
+}
+
+//*********************************************************************************
+// VDC: 16K of RAM holding the 80 column bitmap, which is host_fore
+//********************************************************************************
+
+static unsigned char vdc_regs[38];
+
+static unsigned vdc_update_address(void)
+{
+    return ((vdc_regs[18] << 8) | vdc_regs[19]) & 0x3fff;
+}
+
+static void vdc_set_update_address(unsigned address)
+{
+    vdc_regs[18] = (address >> 8) & 0x3f;
+    vdc_regs[19] = address & 0xff;
+}
+
+static void vdc_store(unsigned address, unsigned char value)
+{
+    if(address < sizeof(host_fore))
+    {
+        host_fore[address] = value;
+        pixels_fore += 8;
+    }
+}
+
+unsigned char VdcRead(unsigned char reg)
+{
+    unsigned address;
+    unsigned char value;
+
+    COUNT(VdcRead);
+
+    if(reg != 31)
+        return vdc_regs[reg];
+
+    address = vdc_update_address();
+    value = (address < sizeof(host_fore)) ? host_fore[address] : 0;
+    vdc_set_update_address(address + 1);
+
+    return value;
+}
+
+void VdcWrite(unsigned char reg, unsigned char value)
+{
+    unsigned address, source, n;
+
+    COUNT(VdcWrite);
+
+    vdc_regs[reg] = value;
+    address = vdc_update_address();
+
+    if(reg == 31)
+    {
+        vdc_store(address, value);
+        vdc_set_update_address(address + 1);
+    }
+    else if(reg == 30)
+    {
+        // block fill with the data register, or copy when bit 7 of reg 24 is set
+        source = ((vdc_regs[32] << 8) | vdc_regs[33]) & 0x3fff;
+
+        for(n = 0; n < (value ? value : 256); n++)
+        {
+            if(vdc_regs[24] & 0x80)
+                vdc_store(address + n, host_fore[(source + n) & 0x3fff]);
+            else
+                vdc_store(address + n, vdc_regs[31]);
+        }
+
+        vdc_set_update_address(address + n);
+    }
+}
+
+//*********************************************************************************
+// VLIR files
+//********************************************************************************
+
+#define HOST_FILES      8
+#define HOST_RECORDS    127
+
+struct host_file {
+    char name[17];
+    unsigned char records;          // records in use
+    unsigned char *data[HOST_RECORDS];
+    unsigned size[HOST_RECORDS];
+};
+
+static struct host_file files[HOST_FILES];
+static struct host_file *open_file;
+static int current_record;
+
+static struct host_file *find_file(const char *name)
+{
+    int i;
+
+    for(i = 0; i < HOST_FILES; i++)
+        if(files[i].name[0] && !strcmp(files[i].name, name))
+            return &files[i];
+
+    return 0;
+}
+
+static struct host_file *new_file(const char *name)
+{
+    int i;
+
+    for(i = 0; i < HOST_FILES; i++)
+    {
+        if(!files[i].name[0])
+        {
+            strncpy(files[i].name, name, 16);
+            return &files[i];
+        }
+    }
+
+    return 0;
+}
+
+// Read a VLIR file in Convert format: the directory entry and signature
+// block, the header block, the record table (blocks and last byte index of
+// each record) and then the records, one 254 byte block after the other.
+static struct host_file *load_cvt(const char *name)
+{
+    char path[512], upper[17];
+    unsigned char *image, *table;
+    struct host_file *file;
+    long length, offset;
+    FILE *f;
+    int i;
+
+    for(i = 0; name[i] && i < 16; i++)
+        upper[i] = toupper((unsigned char)name[i]);
+    upper[i] = 0;
+
+    snprintf(path, sizeof(path), "%s/%s.cvt", file_dir, name);
+    if(!(f = fopen(path, "rb")))
+    {
+        snprintf(path, sizeof(path), "%s/%s.cvt", file_dir, upper);
+        if(!(f = fopen(path, "rb")))
+            return 0;
+    }
+
+    fseek(f, 0, SEEK_END);
+    length = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    image = malloc(length);
+    if(fread(image, 1, length, f) != (size_t)length || length < 762 || !(file = new_file(name)))
+    {
+        fclose(f);
+        free(image);
+        return 0;
+    }
+    fclose(f);
+
+    table = image + 508;
+    offset = 762;
+
+    for(i = 0; i < HOST_RECORDS; i++)
+    {
+        if(table[i * 2] == 0 && table[i * 2 + 1] == 0)
+            break;
+
+        if(table[i * 2])
+        {
+            file->size[i] = (table[i * 2] - 1) * 254 + table[i * 2 + 1] - 1;
+            if(offset + file->size[i] > length)
+                file->size[i] = length - offset;
+            file->data[i] = malloc(file->size[i]);
+            memcpy(file->data[i], image + offset, file->size[i]);
+            offset += table[i * 2] * 254;
+        }
+    }
+    file->records = i;
+
+    free(image);
+    return file;
+}
+
+char OpenRecordFile(char *name)
+{
+    COUNT(OpenRecordFile);
+
+    if(!(open_file = find_file(name)))
+        open_file = load_cvt(name);
+
+    current_record = 0;
+    return open_file ? 0 : FILE_NOT_FOUND;
+}
+
+char CloseRecordFile(void)
+{
+    COUNT(CloseRecordFile);
+    open_file = 0;
+    return 0;
+}
+
+char PointRecord(char record)
+{
+    COUNT(PointRecord);
+
+    if(!open_file || (unsigned char)record >= open_file->records)
+        return INV_RECORD;
+
+    current_record = (unsigned char)record;
+    return 0;
+}
+
+char ReadRecord(char *buffer, unsigned length)
+{
+    unsigned size;
+
+    COUNT(ReadRecord);
+
+    if(!open_file)
+        return INV_RECORD;
+
+    size = open_file->size[current_record];
+    if(size)
+        memcpy(buffer, open_file->data[current_record], size < length ? size : length);
+
+    return (size > length) ? BFR_OVERFLOW : 0;
+}
+
+char WriteRecord(char *buffer, unsigned length)
+{
+    COUNT(WriteRecord);
+
+    if(!open_file)
+        return INV_RECORD;
+
+    free(open_file->data[current_record]);
+    open_file->data[current_record] = malloc(length ? length : 1);
+    memcpy(open_file->data[current_record], buffer, length);
+    open_file->size[current_record] = length;
+
+    return 0;
+}
+
+// insert an empty record after the current one and point at it
+char AppendRecord(void)
+{
+    int i, at;
+
+    COUNT(AppendRecord);
+
+    if(!open_file || open_file->records == HOST_RECORDS)
+        return INV_RECORD;
+
+    at = open_file->records ? current_record + 1 : 0;
+    for(i = open_file->records; i > at; i--)
+    {
+        open_file->data[i] = open_file->data[i - 1];
+        open_file->size[i] = open_file->size[i - 1];
+    }
+
+    open_file->data[at] = 0;
+    open_file->size[at] = 0;
+    open_file->records++;
+    current_record = at;
+
+    return 0;
+}
+
+char SaveFile(char skip, struct fileheader *header)
+{
+    (void)skip;
+
+    COUNT(SaveFile);
+
+    return (find_file(header->name) || new_file(header->name)) ? 0 : INV_RECORD;
+}
+
+//*********************************************************************************
+// driver interface
+//********************************************************************************
+
+void host_init(unsigned char os, unsigned char columns80, const char *dir, const char *app_name)
+{
+    struct host_file *app;
+
+    os_type = os;
+    graphMode = (os == GEOS128 && columns80) ? 0x80 : 0x00;
+    file_dir = dir;
+    application = app_name;
+    otherPressVec = no_press;
+
+    // the application's overlay records, empty since they are linked in
+    app = new_file(application);
+    app->records = 6;
+}
+
+void host_report(FILE *out, const char *label)
+{
+    unsigned long total = 0;
+    int i;
+
+    for(i = 0; i < CALL_COUNT; i++)
+        total += calls[i];
+
+    fprintf(out, "%-16s %6lu calls %8lu fore px %8lu back px  ", label, total, pixels_fore, pixels_back);
+    for(i = 0; i < CALL_COUNT; i++)
+        if(calls[i])
+            fprintf(out, " %s %lu", call_names[i], calls[i]);
+    fprintf(out, "\n");
+
+    memset(calls, 0, sizeof(calls));
+    pixels_fore = pixels_back = 0;
+}
+
+int host_write_pbm(const char *path)
+{
+    FILE *f = fopen(path, "wb");
+
+    if(!f)
+        return 1;
+
+    fprintf(f, "P4\n%u %u\n", host_width(), HOST_HEIGHT);
+    fwrite(host_fore, 1, host_width() / 8 * HOST_HEIGHT, f);
+    fclose(f);
+
+    return 0;
+}
+
+long host_compare_pbm(const char *path)
+{
+    unsigned char line[HOST_WIDTH_MAX / 8];
+    unsigned width, height, x, y, bytes = host_width() / 8;
+    long differ = 0;
+    FILE *f = fopen(path, "rb");
+
+    if(!f)
+        return -1;
+
+    if(fscanf(f, "P4 %u %u", &width, &height) != 2 || fgetc(f) == EOF ||
+       width != host_width() || height != HOST_HEIGHT)
+    {
+        fclose(f);
+        return -1;
+    }
+
+    for(y = 0; y < HOST_HEIGHT; y++)
+    {
+        if(fread(line, 1, bytes, f) != bytes)
+        {
+            fclose(f);
+            return -1;
+        }
+
+        for(x = 0; x < bytes; x++)
+        {
+            unsigned char d = line[x] ^ host_fore[y * bytes + x];
+
+            for(; d; d &= d - 1)
+                differ++;
+        }
+    }
+
+    fclose(f);
+    return differ;
+}
@@ -0,0 +1,194 @@
+//===================================================================================
+//
+//                                  GEOCHESS
+//
+// geoChess is a chess game for GEOS under the Commodore 64 and 128 computers
+//
+// Written by Scott Hutter
+// Nov 2023
+//
+// You are free to modify this code as desired, as long as original author credit
+// is mentioned for both the geos code and the included AI engines
+//===================================================================================
+
+//*********************************************************************************
+//
+// Host stand-in for the parts of the cc65 GEOS library geochess.c uses.  Put
+// this directory on the include path instead of cc65's and link geos-host.c:
+// drawing goes to an in-memory 320x200 or 640x200 bitmap (plus the
+// background buffer), files are the .cvt images of the disk or live in
+// memory, and the C128's VDC is emulated behind VdcRead()/VdcWrite().  Every
+// call and every pixel written is counted, so UI code paths can be replayed
+// and measured natively (see geochess-replay.c).
+//
+// The bitmaps are linear, one bit per pixel with bit 7 leftmost, which is
+// the VDC's layout.  The VIC's card layout and the system font are not
+// modelled: text in the system font is drawn as one distinct stamp per
+// character so changes still show up in the images.
+//
+//********************************************************************************
+
+#ifndef GEOS_HOST_H
+#define GEOS_HOST_H
+
+#define GEOS_HOST
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define SC_PIX_WIDTH        320
+#define SC_PIX_HEIGHT       200
+#define SCREENPIXELWIDTH    640
+
+#define GEOS64      0x00
+#define GEOS128     0x80
+
+#define HORIZONTAL  0x00
+#define VERTICAL    0x80
+#define MENU_ACTION 0x00
+#define SUB_MENU    0x80
+
+#define ST_WR_FORE  0x80
+#define ST_WR_BACK  0x40
+
+#define USR         3
+#define APPL_DATA   7
+#define VLIR        1
+
+typedef void (*void_func)(void);
+
+struct window {
+    unsigned char top, bot;
+    unsigned left, right;
+};
+
+struct pixel {
+    unsigned x;
+    unsigned char y;
+};
+
+struct menuitem {
+    char *name;
+    char type;
+    void *rest;
+};
+
+struct menu {
+    struct window size;
+    char number;
+    struct menuitem items[];
+};
+
+struct fontdesc;
+
+struct fileheader {
+    char *name;                     // SaveFile() takes the file name from here
+    unsigned char icon_desc[3];
+    unsigned char icon_pic[63];
+    unsigned char dostype;
+    unsigned char type;
+    unsigned char structure;
+    unsigned load_address, end_address, exec_address;
+    char class_name[19];
+    char author[63];
+    char note[96];
+};
+
+// kernal variables
+extern unsigned char dispBufferOn;
+extern unsigned char graphMode;
+extern unsigned mouseXPos;
+extern unsigned char mouseYPos;
+extern void_func otherPressVec;
+
+// hardware: inline assembly disappears, the CIA clock stands still
+#define asm(text)
+extern unsigned char host_cia1_tod[4];
+#define CIA1_TOD10THS   host_cia1_tod[0]
+#define CIA1_TODSEC     host_cia1_tod[1]
+#define CIA1_TODMIN     host_cia1_tod[2]
+#define CIA1_TODHR      host_cia1_tod[3]
+
+unsigned char VdcRead(unsigned char reg);
+void VdcWrite(unsigned char reg, unsigned char value);
+
+// overlays are linked in, loading one only counts the call
+extern char host_overlay_area[];
+#define OVERLAY_AREA    host_overlay_area
+#define OVERLAY_SIZE    1
+
+char get_ostype(void);
+void MainLoop(void);
+void EnterDeskTop(void);
+char DlgBoxOk(const char *line1, const char *line2);
+void SetNewMode(void);
+
+void SetPattern(unsigned char pattern);
+void InitDrawWindow(struct window *win);
+void Rectangle(void);
+void RecoverRectangle(void);
+void ImprintRectangle(void);
+void HorizontalLine(unsigned char pattern, unsigned char y, unsigned xstart, unsigned xend);
+void VerticalLine(unsigned char pattern, unsigned char ystart, unsigned char yend, unsigned x);
+
+void UseSystemFont(void);
+void LoadCharSet(struct fontdesc *font);
+void PutChar(char c, unsigned char y, unsigned x);
+void PutString(char *s, unsigned char y, unsigned x);
+
+char IsMseInRegion(struct window *win);
+void DrawSprite(char sprite, const char *data);
+void PosSprite(char sprite, struct pixel *position);
+void EnablSprite(char sprite);
+void DisablSprite(char sprite);
+
+void DoMenu(struct menu *menu);
+void RecoverAllMenus(void);
+
+char OpenRecordFile(char *name);
+char CloseRecordFile(void);
+char PointRecord(char record);
+char ReadRecord(char *buffer, unsigned length);
+char WriteRecord(char *buffer, unsigned length);
+char AppendRecord(void);
+char SaveFile(char skip, struct fileheader *header);
+
+//*********************************************************************************
+// stand-in control, for the replay driver
+//********************************************************************************
+
+#define HOST_WIDTH_MAX      640
+#define HOST_HEIGHT         200
+
+struct host_sprite {
+    const char *data;
+    unsigned x;
+    unsigned char y;
+    unsigned char enabled;
+};
+
+extern unsigned char host_fore[HOST_WIDTH_MAX / 8 * HOST_HEIGHT];
+extern unsigned char host_back[HOST_WIDTH_MAX / 8 * HOST_HEIGHT];
+extern struct host_sprite host_sprites[8];
+extern struct menu *host_menu;
+
+// os is GEOS64 or GEOS128; files are looked up as <dir>/<NAME>.cvt; the
+// application's own name opens as an empty VLIR file holding the overlays
+void host_init(unsigned char os, unsigned char columns80, const char *dir, const char *app_name);
+unsigned host_width(void);
+
+// counters since the last call, printed on one line, then cleared
+void host_report(FILE *out, const char *label);
+
+// one press and release at (x, y) through otherPressVec
+void host_click(unsigned x, unsigned char y);
+
+// run the action of a menu item of the current menu or its submenus
+int host_menu_select(const char *name);
+
+// the screen as a PBM image; host_compare_pbm() returns the number of
+// differing pixels, or -1 if the image cannot be read or has another size
+int host_write_pbm(const char *path);
+long host_compare_pbm(const char *path);
+
+#endif